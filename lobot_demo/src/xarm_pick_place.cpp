@@ -53,7 +53,9 @@ int main(int argc, char** argv)
     target_pose.position.x = 0;
     target_pose.position.y = 0.18;
     target_pose.position.z = 0.05;
-    target_pose.orientation = tf::createQuaternionMsgFromRollPitchYaw(0, M_PI / 4, 0);
+    // The arm only reaches orientations in its vertical plane, i.e. with the yaw of the azimuth of the position
+    target_pose.orientation = tf::createQuaternionMsgFromRollPitchYaw(
+        0, M_PI / 4, atan2(target_pose.position.y, target_pose.position.x));
     move_group.setJointValueTarget(target_pose);
     success = (move_group.move() == moveit::planning_interface::MoveItErrorCode::SUCCESS);
     ROS_INFO_NAMED("xarm_pick_place", "Visualizing plan 1 (pose goal) %s", success ? "" : "FAILED");
@@ -0,0 +1,147 @@
+#ifndef FRAME_PARSER_H
+#define FRAME_PARSER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "hid/lobot_protocol.hpp"
+
+// Splits the byte stream of the control board into the frames of lobot_protocol. Bytes may arrive in any chunks, e.g.
+// padded HID reports. Bytes that do not start a frame with a valid length are skipped until the next header. As frames
+// fit into a 64-byte report, a 0x55 length is invalid too, so the last two bytes of a run of 0x55 are the header.
+class FrameParser
+{
+public:
+  // Parameters of a frame, valid during the call only
+  typedef std::function<void(const unsigned char* params, size_t size)> Callback;
+
+  std::uint64_t getFrameNum() const
+  {
+    return frame_num_;
+  }
+
+  std::uint64_t getInvalidLengthNum() const
+  {
+    return invalid_length_num_;
+  }
+
+  std::uint64_t getUnhandledFrameNum() const
+  {
+    return unhandled_frame_num_;
+  }
+
+  // Appends data and calls the callbacks of the complete frames
+  void feed(const unsigned char* data, size_t size);
+
+  // Drops a partial frame, e.g. when its rest will not arrive
+  void reset()
+  {
+    begin_ = 0;
+    size_ = 0;
+  }
+
+  void setCallback(unsigned cmd, const Callback& callback)
+  {
+    callbacks_[cmd & 0xFF] = callback;
+  }
+
+private:
+  // Holds several of the longest frames
+  static constexpr size_t CAPACITY = 256;
+
+  std::array<unsigned char, CAPACITY> buffer_;
+  size_t begin_ = 0;
+  size_t size_ = 0;
+
+  std::array<Callback, 256> callbacks_;
+
+  std::uint64_t frame_num_ = 0;
+  std::uint64_t invalid_length_num_ = 0;
+  std::uint64_t unhandled_frame_num_ = 0;
+
+  unsigned char at(size_t i) const
+  {
+    return buffer_[(begin_ + i) % CAPACITY];
+  }
+
+  void pop(size_t n)
+  {
+    begin_ = (begin_ + n) % CAPACITY;
+    size_ -= n;
+  }
+
+  void push(unsigned char byte)
+  {
+    if (size_ == CAPACITY)
+    {
+      pop(1);
+    }
+    buffer_[(begin_ + size_) % CAPACITY] = byte;
+    ++size_;
+  }
+
+  void parse();
+};
+
+inline void FrameParser::feed(const unsigned char* data, size_t size)
+{
+  for (size_t i = 0; i != size; ++i)
+  {
+    push(data[i]);
+    // Parsing as frames complete keeps the buffer from overflowing however large the chunk
+    if (size_ == CAPACITY)
+    {
+      parse();
+    }
+  }
+  parse();
+}
+
+inline void FrameParser::parse()
+{
+  while (size_ >= 3)
+  {
+    // Resynchronize on the next header
+    if (at(0) != FRAME_HEADER || at(1) != FRAME_HEADER)
+    {
+      pop(1);
+      continue;
+    }
+
+    const size_t length = at(2);
+    if (length < lobot_protocol::MIN_LENGTH || length > lobot_protocol::MAX_LENGTH)
+    {
+      ++invalid_length_num_;
+      pop(1);
+      continue;
+    }
+    if (size_ < length + 2)
+    {
+      return;
+    }
+
+    // Parameters contiguous for the callback
+    std::array<unsigned char, lobot_protocol::MAX_LENGTH> params;
+    const size_t param_size = length - lobot_protocol::MIN_LENGTH;
+    for (size_t i = 0; i != param_size; ++i)
+    {
+      params[i] = at(lobot_protocol::HEADER_SIZE + i);
+    }
+    const auto cmd = at(3);
+    pop(length + 2);
+
+    ++frame_num_;
+    if (callbacks_[cmd])
+    {
+      callbacks_[cmd](params.data(), param_size);
+    }
+    else
+    {
+      ++unhandled_frame_num_;
+    }
+  }
+}
+
+#endif  // FRAME_PARSER_H
@@ -0,0 +1,238 @@
+#ifndef LOBOT_PROTOCOL_H
+#define LOBOT_PROTOCOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#define FRAME_HEADER 0x55
+
+// Messages of the Lobot servo control board. A frame is 0x55 0x55 length command parameters..., where length counts
+// itself, the command and the parameters. Each request has a fixed parameter size, so it is encoded into a std::array
+// of its exact frame size, and replies are decoded from the parameters in place.
+namespace lobot_protocol
+{
+constexpr std::size_t HEADER_SIZE = 4;  // Two header bytes, length and command
+constexpr std::size_t MIN_LENGTH = 2;
+constexpr std::size_t MAX_LENGTH = 62;  // Frames of the board fit into a 64-byte HID report
+
+constexpr std::uint8_t CMD_MULT_SERVO_SPIN = 3;
+constexpr std::uint8_t CMD_ACTION_GROUP_RUN = 6;
+constexpr std::uint8_t CMD_ACTION_GROUP_STOP = 7;
+constexpr std::uint8_t CMD_ACTION_GROUP_SPEED = 11;
+constexpr std::uint8_t CMD_GET_BATTERY_VOLTAGE = 15;
+constexpr std::uint8_t CMD_MULT_SERVO_UNLOAD = 20;
+constexpr std::uint8_t CMD_MULT_SERVO_POS_READ = 21;
+
+template <typename Message>
+using Frame = std::array<std::uint8_t, HEADER_SIZE + Message::PARAM_SIZE>;
+
+inline void encodeUint16(std::uint16_t value, std::uint8_t* bytes)
+{
+  bytes[0] = value & 0xFF;
+  bytes[1] = (value >> 8) & 0xFF;
+}
+
+inline std::uint16_t decodeUint16(const std::uint8_t* bytes)
+{
+  return static_cast<std::uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+// Writes the frame of message to frame, which holds Frame<Message>().size() bytes
+template <typename Message>
+void encode(const Message& message, std::uint8_t* frame)
+{
+  static_assert(MIN_LENGTH + Message::PARAM_SIZE <= MAX_LENGTH, "Frame does not fit into a report");
+  frame[0] = FRAME_HEADER;
+  frame[1] = FRAME_HEADER;
+  frame[2] = MIN_LENGTH + Message::PARAM_SIZE;
+  frame[3] = Message::CMD;
+  message.encodeParams(frame + HEADER_SIZE);
+}
+
+template <typename Message>
+Frame<Message> encode(const Message& message)
+{
+  Frame<Message> frame;
+  encode(message, frame.data());
+  return frame;
+}
+
+// Moves the servos to their positions within time
+template <std::size_t ServoNum>
+struct MultServoSpin
+{
+  static constexpr std::uint8_t CMD = CMD_MULT_SERVO_SPIN;
+  static constexpr std::size_t PARAM_SIZE = 3 + 3 * ServoNum;
+
+  std::uint16_t time;  // Milliseconds
+  std::array<std::uint8_t, ServoNum> ids;
+  std::array<std::uint16_t, ServoNum> positions;
+
+  void encodeParams(std::uint8_t* params) const
+  {
+    params[0] = ServoNum;
+    encodeUint16(time, params + 1);
+    for (std::size_t i = 0; i != ServoNum; ++i)
+    {
+      params[3 + 3 * i] = ids[i];
+      encodeUint16(positions[i], params + 4 + 3 * i);
+    }
+  }
+};
+
+// Runs a stored action group the given number of times, 0 for endlessly
+struct ActionGroupRun
+{
+  static constexpr std::uint8_t CMD = CMD_ACTION_GROUP_RUN;
+  static constexpr std::size_t PARAM_SIZE = 3;
+
+  std::uint8_t group;
+  std::uint16_t times;
+
+  void encodeParams(std::uint8_t* params) const
+  {
+    params[0] = group;
+    encodeUint16(times, params + 1);
+  }
+};
+
+struct ActionGroupStop
+{
+  static constexpr std::uint8_t CMD = CMD_ACTION_GROUP_STOP;
+  static constexpr std::size_t PARAM_SIZE = 0;
+
+  void encodeParams(std::uint8_t*) const
+  {
+  }
+};
+
+// Sets the speed of an action group in percent, group 0xFF for all groups
+struct ActionGroupSpeed
+{
+  static constexpr std::uint8_t CMD = CMD_ACTION_GROUP_SPEED;
+  static constexpr std::size_t PARAM_SIZE = 3;
+
+  std::uint8_t group;
+  std::uint16_t speed;
+
+  void encodeParams(std::uint8_t* params) const
+  {
+    params[0] = group;
+    encodeUint16(speed, params + 1);
+  }
+};
+
+struct GetBatteryVoltage
+{
+  static constexpr std::uint8_t CMD = CMD_GET_BATTERY_VOLTAGE;
+  static constexpr std::size_t PARAM_SIZE = 0;
+
+  void encodeParams(std::uint8_t*) const
+  {
+  }
+};
+
+// Powers servos off, so that they can be turned by hand
+template <std::size_t ServoNum>
+struct MultServoUnload
+{
+  static constexpr std::uint8_t CMD = CMD_MULT_SERVO_UNLOAD;
+  static constexpr std::size_t PARAM_SIZE = 1 + ServoNum;
+
+  std::array<std::uint8_t, ServoNum> ids;
+
+  void encodeParams(std::uint8_t* params) const
+  {
+    params[0] = ServoNum;
+    for (std::size_t i = 0; i != ServoNum; ++i)
+    {
+      params[1 + i] = ids[i];
+    }
+  }
+};
+
+template <std::size_t ServoNum>
+struct MultServoPosRead
+{
+  static constexpr std::uint8_t CMD = CMD_MULT_SERVO_POS_READ;
+  static constexpr std::size_t PARAM_SIZE = 1 + ServoNum;
+
+  std::array<std::uint8_t, ServoNum> ids;
+
+  void encodeParams(std::uint8_t* params) const
+  {
+    params[0] = ServoNum;
+    for (std::size_t i = 0; i != ServoNum; ++i)
+    {
+      params[1 + i] = ids[i];
+    }
+  }
+};
+
+// Reply of GetBatteryVoltage
+class BatteryVoltageReply
+{
+public:
+  static constexpr std::uint8_t CMD = CMD_GET_BATTERY_VOLTAGE;
+
+  // Returns false unless params hold a voltage
+  bool decode(const std::uint8_t* params, std::size_t size)
+  {
+    if (size != 2)
+    {
+      return false;
+    }
+    voltage_ = decodeUint16(params);
+    return true;
+  }
+
+  // Millivolts
+  std::uint16_t getVoltage() const
+  {
+    return voltage_;
+  }
+
+private:
+  std::uint16_t voltage_ = 0;
+};
+
+// Reply of MultServoPosRead, reads the parameters in place, so they must outlive it
+class ServoPositionsReply
+{
+public:
+  static constexpr std::uint8_t CMD = CMD_MULT_SERVO_POS_READ;
+
+  // Returns false unless params hold the number of servos followed by the ID and position of each
+  bool decode(const std::uint8_t* params, std::size_t size)
+  {
+    if (size == 0 || size != 1 + 3 * static_cast<std::size_t>(params[0]))
+    {
+      return false;
+    }
+    params_ = params;
+    return true;
+  }
+
+  std::size_t getServoNum() const
+  {
+    return params_ ? params_[0] : 0;
+  }
+
+  std::uint8_t getId(std::size_t i) const
+  {
+    return params_[1 + 3 * i];
+  }
+
+  std::uint16_t getPosition(std::size_t i) const
+  {
+    return decodeUint16(params_ + 2 + 3 * i);
+  }
+
+private:
+  const std::uint8_t* params_ = nullptr;
+};
+
+}  // namespace lobot_protocol
+
+#endif  // LOBOT_PROTOCOL_H
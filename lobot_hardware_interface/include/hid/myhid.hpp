@@ -1,13 +1,12 @@
 #ifndef MYHID_H
 #define MYHID_H
 
-#include <initializer_list>
+#include <array>
 #include <stdexcept>
-#include <vector>
 
+#include "hid/frame_parser.hpp"
 #include "hid/hidapi.h"
-
-#define FRAME_HEADER 0x55
+#include "hid/lobot_protocol.hpp"
 
 class MyHid
 {
@@ -21,6 +20,17 @@ public:
 
   void close();
 
+  // Drops the bytes of a frame whose rest was lost
+  void discardPartialFrame()
+  {
+    frame_parser_.reset();
+  }
+
+  const FrameParser& getFrameParser() const
+  {
+    return frame_parser_;
+  }
+
   unsigned short getProductId() const
   {
     return product_id_;
@@ -36,15 +46,21 @@ public:
     return connected_;
   }
 
-  int makeAndSendCmd(const unsigned cmd);
-
-  int makeAndSendCmd(const unsigned cmd, const std::initializer_list<unsigned>& argv);
+  void open();
 
-  int makeAndSendCmd(const unsigned cmd, const std::vector<unsigned>& argv);
+  // Reads a report within timeout_ms, or waiting forever if it is -1, and calls the callbacks of the frames it
+  // completes. Returns the result of hid_read_timeout(), i.e. 0 on timeout and -1 on error.
+  int poll(const int timeout_ms);
 
-  void open();
+  // Writes the frame of a message of lobot_protocol, returns 0 on success and -1 on error
+  template <typename Message>
+  int send(const Message& message);
 
-  void read(std::vector<unsigned>& data, const size_t length);
+  // Called by poll() with the parameters of each frame of command cmd
+  void setFrameCallback(const unsigned cmd, const FrameParser::Callback& callback)
+  {
+    frame_parser_.setCallback(cmd, callback);
+  }
 
   void setProductId(const unsigned short product_id)
   {
@@ -61,6 +77,7 @@ private:
   unsigned short product_id_;
   bool connected_ = false;
   hid_device* device_ = nullptr;
+  FrameParser frame_parser_;
 };
 
 inline void MyHid::close()
@@ -72,112 +89,53 @@ inline void MyHid::close()
   }
 }
 
-inline int MyHid::makeAndSendCmd(const unsigned cmd)
+inline void MyHid::open()
 {
-  if (!connected_)
-  {
-    return -1;
-  }
+  hid_init();
 
-  unsigned char send_buffer[256] = { 0 };
-  send_buffer[0] = 0x00;  // Report ID
-  send_buffer[1] = FRAME_HEADER;
-  send_buffer[2] = FRAME_HEADER;
-  send_buffer[3] = 2;
-  send_buffer[4] = static_cast<unsigned char>(cmd);
-  if (hid_write(device_, send_buffer, send_buffer[3] + 3) != -1)
+  device_ = hid_open(vendor_id_, product_id_, nullptr);
+  if (!device_)
   {
-    return 0;
+    throw std::runtime_error("Cannot open HID device!");
   }
-  return -1;
+
+  connected_ = true;
 }
 
-inline int MyHid::makeAndSendCmd(const unsigned cmd, const std::initializer_list<unsigned>& argv)
+inline int MyHid::poll(const int timeout_ms)
 {
   if (!connected_)
   {
     return -1;
   }
 
-  unsigned cnt = 0;
-  unsigned char send_buffer[256] = { 0 };
-  send_buffer[0] = 0x00;  // Report ID
-  send_buffer[1] = FRAME_HEADER;
-  send_buffer[2] = FRAME_HEADER;
-  send_buffer[4] = static_cast<unsigned char>(cmd);
-  for (const auto& arg : argv)
+  // Input reports of a full-speed device are at most 64 bytes
+  unsigned char report[64];
+  const auto result = static_cast<int>(hid_read_timeout(device_, report, sizeof(report), timeout_ms));
+  if (result > 0)
   {
-    send_buffer[5 + cnt] = static_cast<unsigned char>(arg);
-    ++cnt;
+    frame_parser_.feed(report, result);
   }
-  send_buffer[3] = static_cast<unsigned char>(cnt + 2);
-  if (hid_write(device_, send_buffer, send_buffer[3] + 3) != -1)
-  {
-    return 0;
-  }
-  return -1;
+  return result;
 }
 
-inline int MyHid::makeAndSendCmd(const unsigned cmd, const std::vector<unsigned>& argv)
+template <typename Message>
+inline int MyHid::send(const Message& message)
 {
   if (!connected_)
   {
     return -1;
   }
 
-  unsigned cnt = 0;
-  unsigned char send_buffer[256] = { 0 };
-  send_buffer[0] = 0x00;  // Report ID
-  send_buffer[1] = FRAME_HEADER;
-  send_buffer[2] = FRAME_HEADER;
-  send_buffer[4] = static_cast<unsigned char>(cmd);
-  for (const auto& arg : argv)
-  {
-    send_buffer[5 + cnt] = static_cast<unsigned char>(arg);
-    ++cnt;
-  }
-  send_buffer[3] = static_cast<unsigned char>(cnt + 2);
-  if (hid_write(device_, send_buffer, send_buffer[3] + 3) != -1)
+  // Report ID followed by the frame
+  std::array<unsigned char, 1 + std::tuple_size<lobot_protocol::Frame<Message>>::value> report;
+  report[0] = 0x00;
+  lobot_protocol::encode(message, report.data() + 1);
+  if (hid_write(device_, report.data(), report.size()) != -1)
   {
     return 0;
   }
   return -1;
 }
 
-inline void MyHid::open()
-{
-  hid_init();
-
-  device_ = hid_open(vendor_id_, product_id_, nullptr);
-  if (!device_)
-  {
-    throw std::runtime_error("Cannot open HID device!");
-  }
-
-  connected_ = true;
-}
-
-inline void MyHid::read(std::vector<unsigned>& data, const size_t length)
-{
-  if (length > 256)
-  {
-    return;
-  }
-
-  data.reserve(length);
-  unsigned char receive_buffer[256] = { 0 };
-
-  hid_read(device_, receive_buffer, length + 2);
-  if (receive_buffer[0] == FRAME_HEADER && receive_buffer[1] == FRAME_HEADER && receive_buffer[2] == length)
-  {
-    size_t i = 3;
-    while (i < length + 2)
-    {
-      data.push_back(receive_buffer[i]);
-      ++i;
-    }
-  }
-  return;
-}
-
 #endif  // MYHID_H
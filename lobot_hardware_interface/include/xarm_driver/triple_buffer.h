@@ -0,0 +1,53 @@
+#ifndef XARM_TRIPLE_BUFFER_H
+#define XARM_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+namespace lobot_hardware_interface
+{
+// Passes the latest value from one writer thread to one reader thread without locks or waiting. The writer fills a
+// buffer of its own and swaps it with the shared one, the reader swaps the shared one with its own if it is newer, so
+// neither ever sees a buffer that the other is using.
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() = default;
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Called by the reader, gets the latest value and returns whether it is new since the last call
+  bool read(T& value)
+  {
+    const auto is_new = (shared_.load(std::memory_order_relaxed) & NEW) != 0;
+    if (is_new)
+    {
+      read_index_ = shared_.exchange(read_index_, std::memory_order_acq_rel) & INDEX;
+    }
+    value = buffers_[read_index_];
+    return is_new;
+  }
+
+  // Called by the writer
+  void write(const T& value)
+  {
+    buffers_[write_index_] = value;
+    write_index_ = shared_.exchange(write_index_ | NEW, std::memory_order_acq_rel) & INDEX;
+  }
+
+private:
+  static constexpr unsigned char INDEX = 0x3;
+  static constexpr unsigned char NEW = 0x4;
+
+  T buffers_[3]{};
+
+  // Index of the buffer between the threads, NEW if the writer swapped it in after the last read
+  std::atomic<unsigned char> shared_{ 0 };
+  unsigned char read_index_ = 1;
+  unsigned char write_index_ = 2;
+};
+
+}  // namespace lobot_hardware_interface
+
+#endif  // XARM_TRIPLE_BUFFER_H
@@ -3,11 +3,16 @@
 
 #include <ros/console.h>
 #include <ros/ros.h>
+#include <algorithm>
 #include <array>
-#include <initializer_list>
-#include <vector>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
 
 #include "hid/myhid.hpp"
+#include "xarm_driver/triple_buffer.h"
 
 namespace lobot_hardware_interface
 {
@@ -15,30 +20,80 @@ namespace lobot_hardware_interface
 #define JOINT_NUM 5   // Number of the arm joints
 #define GRIPPER_ID 5  // Index of the gripper joint
 
-#define CMD_MULT_SERVO_SPIN 3
-#define CMD_MULT_SERVO_POS_READ 21
-
+// The control board is only accessed by an I/O thread. For each new command it sends the spin commands and then at
+// once the position request, whose reply it collects while the next control cycle runs. execute() and getJointStates()
+// only exchange values with it and never wait for USB.
 class XarmDriver
 {
 public:
   XarmDriver();
 
+  XarmDriver(const XarmDriver&) = delete;
+  XarmDriver& operator=(const XarmDriver&) = delete;
+
   ~XarmDriver();
 
   void execute(const std::array<double, SERVO_NUM>& cmd, const ros::Duration& period);
 
-  void getJointStates(std::array<double, SERVO_NUM>& joint_states);
+  // Joint states of the latest servo positions that the I/O thread read, extrapolated from the time of their reply to
+  // time by the velocities between the last two replies
+  void getJointStates(std::array<double, SERVO_NUM>& joint_states, std::array<double, SERVO_NUM>& joint_velocities,
+                      const ros::Time& time);
 
 protected:
   MyHid my_hid_;
-  std::array<int, SERVO_NUM> servo_positions_;
+  std::array<int, SERVO_NUM> servo_positions_{ 0 };
 
 private:
-  void getCurrentServoPositions();
+  // Of the control thread, the joint states of the latest reply and their velocities
+  std::array<double, SERVO_NUM> replied_joint_states_{ 0 };
+  std::array<double, SERVO_NUM> replied_joint_velocities_{ 0 };
+  ros::Time replied_stamp_;
+
+  struct ServoCommand
+  {
+    std::array<int, SERVO_NUM> positions;
+    unsigned period;  // Milliseconds for the arm servos to reach their positions
+  };
+
+  struct ServoState
+  {
+    std::array<int, SERVO_NUM> positions;
+    ros::Time stamp;  // Midway between the request and the reply
+  };
+
+  // A position reply is given up after READ_TIMEOUT_MS, the I/O thread checks for new commands every POLL_TIMEOUT_MS
+  // while waiting for it
+  static constexpr int READ_TIMEOUT_MS = 100;
+  static constexpr int POLL_TIMEOUT_MS = 1;
+
+  // Extrapolation of joint states beyond this is not trusted, older servo positions are reported as stale
+  static constexpr double MAX_EXTRAPOLATION = 0.1;
+
+  std::thread io_thread_;
+  std::atomic<bool> io_running_{ false };
+  TripleBuffer<ServoCommand> servo_commands_;
+  TripleBuffer<ServoState> servo_states_;
+
+  // Of the I/O thread, set by the frame callback of position replies
+  std::array<int, SERVO_NUM> received_positions_{ 0 };
+  bool positions_received_ = false;
+
+  static void convertServoPositions(const std::array<int, SERVO_NUM>& servo_positions,
+                                    std::array<double, SERVO_NUM>& joint_states);
+
+  bool readServoPositions(std::array<int, SERVO_NUM>& servo_positions, const int timeout_ms);
+
+  void receiveServoPositions(const unsigned char* params, size_t size);
+
+  void requestServoPositions();
 
   void init();
 
-  void spinServos(const std::initializer_list<unsigned>& id_list, const std::initializer_list<int>& position_list,
+  void ioLoop();
+
+  template <std::size_t N>
+  void spinServos(const std::array<std::uint8_t, N>& ids, const std::array<int, N>& positions,
                   const unsigned period = 2000);
 };
 
@@ -57,76 +112,128 @@ inline void XarmDriver::execute(const std::array<double, SERVO_NUM>& cmd, const
   position_cmds[GRIPPER_ID] = -0.003073 * gripper_cmd * gripper_cmd * gripper_cmd +
                               0.212188 * gripper_cmd * gripper_cmd - 10.335171 * gripper_cmd + 700.907820;
 
-  // Send commands
-  spinServos({ 2, 3, 4, 5, 6 },
-             { position_cmds[4], position_cmds[3], position_cmds[2], position_cmds[1], position_cmds[0] },
-             period.toSec() * 1000);
-  spinServos({ 1 }, { position_cmds[GRIPPER_ID] }, 600);
+  // Hand the commands over to the I/O thread, replacing those it has not sent yet
+  servo_commands_.write({ position_cmds, static_cast<unsigned>(period.toSec() * 1000) });
 }
 
-inline void XarmDriver::getJointStates(std::array<double, SERVO_NUM>& joint_states)
+inline void XarmDriver::getJointStates(std::array<double, SERVO_NUM>& joint_states,
+                                       std::array<double, SERVO_NUM>& joint_velocities, const ros::Time& time)
 {
-  getCurrentServoPositions();
+  ServoState servo_state;
+  if (servo_states_.read(servo_state))
+  {
+    std::array<double, SERVO_NUM> replied_joint_states;
+    convertServoPositions(servo_state.positions, replied_joint_states);
+    const auto interval = (servo_state.stamp - replied_stamp_).toSec();
+    const auto has_interval = !replied_stamp_.isZero() && interval > 0;
+    for (auto i = 0; i != SERVO_NUM; ++i)
+    {
+      replied_joint_velocities_[i] = has_interval ? (replied_joint_states[i] - replied_joint_states_[i]) / interval : 0;
+    }
+    servo_positions_ = servo_state.positions;
+    replied_joint_states_ = replied_joint_states;
+    replied_stamp_ = servo_state.stamp;
+  }
+
+  if (replied_stamp_.isZero())
+  {
+    ROS_WARN_THROTTLE_NAMED(1, "xarm_hardware_interface", "No servo positions received yet");
+    return;
+  }
 
+  // The reply is about half a USB round trip old, plus the time since it arrived
+  const auto reply_age = (time - replied_stamp_).toSec();
+  if (reply_age > MAX_EXTRAPOLATION)
+  {
+    // The servos may have stopped or the board may be gone, hold the last measured positions
+    ROS_WARN_THROTTLE_NAMED(1, "xarm_hardware_interface", "Servo positions are stale by %.3f s", reply_age);
+    joint_states = replied_joint_states_;
+    joint_velocities.fill(0);
+    return;
+  }
+  const auto age = std::max(reply_age, 0.0);
+  for (auto i = 0; i != SERVO_NUM; ++i)
+  {
+    joint_states[i] = replied_joint_states_[i] + replied_joint_velocities_[i] * age;
+  }
+  joint_velocities = replied_joint_velocities_;
+}
+
+inline void XarmDriver::convertServoPositions(const std::array<int, SERVO_NUM>& servo_positions,
+                                              std::array<double, SERVO_NUM>& joint_states)
+{
   // State of arm joints, convert positions to radians
   for (auto i = 1; i != SERVO_NUM; ++i)
   {
     joint_states[JOINT_NUM - i] =
-        (i == 4) ? ((500 - servo_positions_[i]) * M_PI / 750) : ((servo_positions_[i] - 500) * M_PI / 750);
+        (i == 4) ? ((500 - servo_positions[i]) * M_PI / 750) : ((servo_positions[i] - 500) * M_PI / 750);
   }
 
   // State of the gripper joint, mapped from angle to distance
   joint_states[GRIPPER_ID] =
       0.03 -
-      (-1.213930e-4 * servo_positions_[0] * servo_positions_[0] - 0.015326 * servo_positions_[0] + 67.610949) / 2000;
+      (-1.213930e-4 * servo_positions[0] * servo_positions[0] - 0.015326 * servo_positions[0] + 67.610949) / 2000;
 }
 
-inline void XarmDriver::getCurrentServoPositions()
+// Returns false if no position reply arrived within timeout_ms, leaving servo_positions unchanged
+inline bool XarmDriver::readServoPositions(std::array<int, SERVO_NUM>& servo_positions, const int timeout_ms)
 {
-  my_hid_.makeAndSendCmd(CMD_MULT_SERVO_POS_READ, { SERVO_NUM, 1, 2, 3, 4, 5, 6 });
-  std::vector<unsigned> received_data;
-  my_hid_.read(received_data, 21);
-
-  if (received_data.size() != 0 && received_data[0] == CMD_MULT_SERVO_POS_READ && received_data[1] == SERVO_NUM)
+  const auto deadline = ros::WallTime::now() + ros::WallDuration(timeout_ms * 1e-3);
+  auto remaining_ms = timeout_ms;
+  while (!positions_received_)
   {
-    auto position_it = servo_positions_.begin();
-    decltype(received_data.size()) i = 0;
-    while (position_it != servo_positions_.end())
+    if (remaining_ms < 0 || my_hid_.poll(remaining_ms) < 0)
     {
-      *position_it = static_cast<int>(received_data[3 * i + 3]) + static_cast<int>(received_data[3 * i + 4] << 8);
-      ++position_it;
-      ++i;
+      return false;
     }
+    remaining_ms = static_cast<int>(std::ceil((deadline - ros::WallTime::now()).toSec() * 1e3));
   }
+
+  positions_received_ = false;
+  servo_positions = received_positions_;
+  return true;
 }
 
-inline void XarmDriver::spinServos(const std::initializer_list<unsigned>& id_list,
-                                   const std::initializer_list<int>& position_list, const unsigned period)
+inline void XarmDriver::receiveServoPositions(const unsigned char* params, size_t size)
 {
-  auto id_list_size = id_list.size();
-  auto position_list_size = position_list.size();
-  if (id_list_size != position_list_size)
+  lobot_protocol::ServoPositionsReply reply;
+  if (!reply.decode(params, size) || reply.getServoNum() != SERVO_NUM)
   {
+    ROS_WARN_THROTTLE_NAMED(1, "xarm_hardware_interface", "Invalid servo position reply of %zu bytes", size);
     return;
   }
 
-  unsigned per = (period > 5000) ? 5000 : period;
-  std::vector<unsigned> argv;
-  argv.push_back(static_cast<unsigned>(id_list_size));
-  argv.push_back(per & 0xFF);
-  argv.push_back((per >> 8) & 0xFF);
-  auto id_it = id_list.begin();
-  auto position_it = position_list.begin();
-  while (id_it != id_list.end())
+  for (auto i = 0; i != SERVO_NUM; ++i)
   {
-    argv.push_back(*id_it);
-    argv.push_back(*position_it & 0xFF);
-    argv.push_back((*position_it >> 8) & 0xFF);
-    ++id_it;
-    ++position_it;
+    const auto id = reply.getId(i);
+    if (id < 1 || id > SERVO_NUM)
+    {
+      ROS_WARN_THROTTLE_NAMED(1, "xarm_hardware_interface", "Invalid servo ID %u in position reply", id);
+      return;
+    }
+    received_positions_[id - 1] = reply.getPosition(i);
   }
+  positions_received_ = true;
+}
+
+inline void XarmDriver::requestServoPositions()
+{
+  const lobot_protocol::MultServoPosRead<SERVO_NUM> request{ { 1, 2, 3, 4, 5, 6 } };
+  my_hid_.send(request);
+}
 
-  my_hid_.makeAndSendCmd(CMD_MULT_SERVO_SPIN, argv);
+template <std::size_t N>
+inline void XarmDriver::spinServos(const std::array<std::uint8_t, N>& ids, const std::array<int, N>& positions,
+                                   const unsigned period)
+{
+  lobot_protocol::MultServoSpin<N> spin;
+  spin.time = (period > 5000) ? 5000 : period;
+  spin.ids = ids;
+  for (std::size_t i = 0; i != N; ++i)
+  {
+    spin.positions[i] = static_cast<std::uint16_t>(positions[i]);
+  }
+  my_hid_.send(spin);
 }
 
 }  // namespace lobot_hardware_interface
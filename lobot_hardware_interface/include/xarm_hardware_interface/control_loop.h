@@ -0,0 +1,63 @@
+#ifndef XARM_CONTROL_LOOP_H
+#define XARM_CONTROL_LOOP_H
+
+#include <ros/ros.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace lobot_hardware_interface
+{
+// Runs a callback at a fixed rate on a dedicated thread, sleeping until absolute deadlines of CLOCK_MONOTONIC so that
+// the rate does not drift with the execution time of the callback
+class ControlLoop
+{
+public:
+  typedef std::function<void(const ros::Time&, const ros::Duration&)> Callback;
+
+  struct Statistics
+  {
+    std::uint64_t cycle_num;
+    std::uint64_t overrun_num;  // Cycles that started after the deadline of the next one
+    double max_latency;         // Seconds between a deadline and the start of its cycle
+    double max_execution_time;  // Seconds of the longest callback
+  };
+
+  // priority > 0 runs the thread with SCHED_FIFO at that priority, cpu >= 0 pins it to that CPU
+  ControlLoop(double rate, int priority, int cpu, const Callback& callback);
+
+  ControlLoop(const ControlLoop&) = delete;
+  ControlLoop& operator=(const ControlLoop&) = delete;
+
+  ~ControlLoop();
+
+  Statistics getStatistics() const;
+
+  void start();
+
+  void stop();
+
+private:
+  const std::int64_t period_ns_;
+  const int priority_;
+  const int cpu_;
+  const Callback callback_;
+
+  std::atomic<bool> running_{ false };
+  std::thread thread_;
+
+  // Written by the control thread only
+  std::atomic<std::uint64_t> cycle_num_{ 0 };
+  std::atomic<std::uint64_t> overrun_num_{ 0 };
+  std::atomic<std::int64_t> max_latency_ns_{ 0 };
+  std::atomic<std::int64_t> max_execution_ns_{ 0 };
+
+  void run();
+
+  void setSchedule();
+};
+
+}  // namespace lobot_hardware_interface
+
+#endif  // XARM_CONTROL_LOOP_H
@@ -9,8 +9,10 @@
 #include <hardware_interface/robot_hw.h>
 #include <ros/ros.h>
 #include <array>
+#include <memory>
 
 #include "xarm_driver/xarm_driver.h"
+#include "xarm_hardware_interface/control_loop.h"
 
 namespace lobot_hardware_interface
 {
@@ -23,7 +25,7 @@ public:
 
   void read(const ros::Time& time, const ros::Duration& period) override;
 
-  void update(const ros::TimerEvent& e);
+  void update(const ros::Time& time, const ros::Duration& period);
 
   void write(const ros::Time& time, const ros::Duration& period) override;
 
@@ -45,7 +47,8 @@ private:
   // Driver
   XarmDriver xarm_driver_;
 
-  ros::Timer timer;
+  // Runs read, update and write, declared after everything it touches so that it stops first
+  std::unique_ptr<ControlLoop> control_loop_;
 
   // Gripper control
   actionlib::SimpleActionServer<control_msgs::GripperCommandAction> gripper_cmd_action_server_;
@@ -58,17 +61,15 @@ private:
 // Get joints' current angles
 inline void XarmHardwareInterface::read(const ros::Time& time, const ros::Duration& period)
 {
-  xarm_driver_.getJointStates(joint_positions_);
+  xarm_driver_.getJointStates(joint_positions_, joint_velocities_, time);
 }
 
-inline void XarmHardwareInterface::update(const ros::TimerEvent& e)
+// One cycle of the control loop, period is the measured time since the last cycle
+inline void XarmHardwareInterface::update(const ros::Time& time, const ros::Duration& period)
 {
-  auto current_time = ros::Time::now();
-  auto period = ros::Duration(e.current_real - e.last_real);
-
-  read(current_time, period);
-  controller_manager_.update(current_time, period);
-  write(current_time, period);
+  read(time, period);
+  controller_manager_.update(time, period);
+  write(time, period);
 }
 
 // Send commands to control board
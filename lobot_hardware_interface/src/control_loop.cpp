@@ -0,0 +1,160 @@
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include "xarm_hardware_interface/control_loop.h"
+
+namespace lobot_hardware_interface
+{
+namespace
+{
+constexpr std::int64_t NSEC_PER_SEC = 1000000000;
+
+std::int64_t now()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// Sleeps until time, resuming after signal handlers
+void sleepUntil(std::int64_t time)
+{
+  timespec ts;
+  ts.tv_sec = time / NSEC_PER_SEC;
+  ts.tv_nsec = time % NSEC_PER_SEC;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+  {
+  }
+}
+
+void updateMax(std::atomic<std::int64_t>& max, std::int64_t value)
+{
+  if (value > max.load(std::memory_order_relaxed))
+  {
+    max.store(value, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace
+
+ControlLoop::ControlLoop(double rate, int priority, int cpu, const Callback& callback)
+  : period_ns_(std::llround(NSEC_PER_SEC / rate)), priority_(priority), cpu_(cpu), callback_(callback)
+{
+}
+
+ControlLoop::~ControlLoop()
+{
+  stop();
+}
+
+ControlLoop::Statistics ControlLoop::getStatistics() const
+{
+  Statistics statistics;
+  statistics.cycle_num = cycle_num_.load(std::memory_order_relaxed);
+  statistics.overrun_num = overrun_num_.load(std::memory_order_relaxed);
+  statistics.max_latency = static_cast<double>(max_latency_ns_.load(std::memory_order_relaxed)) / NSEC_PER_SEC;
+  statistics.max_execution_time = static_cast<double>(max_execution_ns_.load(std::memory_order_relaxed)) / NSEC_PER_SEC;
+  return statistics;
+}
+
+void ControlLoop::start()
+{
+  if (running_.exchange(true))
+  {
+    return;
+  }
+  thread_ = std::thread(&ControlLoop::run, this);
+}
+
+void ControlLoop::stop()
+{
+  running_ = false;
+  if (thread_.joinable())
+  {
+    thread_.join();
+
+    const auto statistics = getStatistics();
+    ROS_INFO_NAMED("xarm_hardware_interface",
+                   "Control loop stopped after %lu cycles, %lu overruns, max latency %.3f ms, max execution %.3f ms",
+                   static_cast<unsigned long>(statistics.cycle_num), static_cast<unsigned long>(statistics.overrun_num),
+                   statistics.max_latency * 1e3, statistics.max_execution_time * 1e3);
+  }
+}
+
+void ControlLoop::run()
+{
+  setSchedule();
+
+  // The first cycle reports the nominal period
+  auto deadline = now();
+  auto last_start = deadline - period_ns_;
+  std::uint64_t reported_overrun_num = 0;
+  while (running_.load(std::memory_order_relaxed) && ros::ok())
+  {
+    const auto start = now();
+    updateMax(max_latency_ns_, start - deadline);
+
+    callback_(ros::Time::now(), ros::Duration().fromNSec(start - last_start));
+    last_start = start;
+
+    const auto end = now();
+    updateMax(max_execution_ns_, end - start);
+    cycle_num_.store(cycle_num_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    // Skip the deadlines already missed instead of running cycles back to back
+    deadline += period_ns_;
+    if (end > deadline)
+    {
+      const auto missed_num = (end - deadline) / period_ns_ + 1;
+      deadline += missed_num * period_ns_;
+      overrun_num_.store(overrun_num_.load(std::memory_order_relaxed) + missed_num, std::memory_order_relaxed);
+    }
+
+    const auto overrun_num = overrun_num_.load(std::memory_order_relaxed);
+    if (overrun_num != reported_overrun_num)
+    {
+      ROS_WARN_THROTTLE_NAMED(10, "xarm_hardware_interface",
+                              "Control loop missed %lu deadlines so far, last cycle took %.3f ms",
+                              static_cast<unsigned long>(overrun_num), (end - start) * 1e-6);
+      reported_overrun_num = overrun_num;
+    }
+
+    sleepUntil(deadline);
+  }
+}
+
+// Failures leave the thread with the default schedule, e.g. without CAP_SYS_NICE or an rtprio limit
+void ControlLoop::setSchedule()
+{
+  if (priority_ > 0)
+  {
+    sched_param param;
+    param.sched_priority =
+        std::min(std::max(priority_, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+    const auto error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error)
+    {
+      ROS_WARN_NAMED("xarm_hardware_interface", "Cannot set SCHED_FIFO priority %d of control loop: %s",
+                     param.sched_priority, std::strerror(error));
+    }
+  }
+
+  if (cpu_ >= 0)
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu_, &cpu_set);
+    const auto error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (error)
+    {
+      ROS_WARN_NAMED("xarm_hardware_interface", "Cannot pin control loop to CPU %d: %s", cpu_, std::strerror(error));
+    }
+  }
+}
+
+}  // namespace lobot_hardware_interface
@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "hid/frame_parser.hpp"
+#include "hid/lobot_protocol.hpp"
+
+namespace
+{
+constexpr std::size_t SERVO_NUM = 6;
+
+// Spin command of the arm servos, as sent every control cycle
+void encodeMultServoSpin(benchmark::State& state)
+{
+  lobot_protocol::MultServoSpin<SERVO_NUM - 1> spin{ 20, { 2, 3, 4, 5, 6 }, { 500, 500, 500, 500, 500 } };
+  for (auto _ : state)
+  {
+    spin.positions[0] = static_cast<std::uint16_t>(state.iterations() & 0x3FF);
+    auto frame = lobot_protocol::encode(spin);
+    benchmark::DoNotOptimize(frame);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void encodeMultServoPosRead(benchmark::State& state)
+{
+  const lobot_protocol::MultServoPosRead<SERVO_NUM> request{ { 1, 2, 3, 4, 5, 6 } };
+  for (auto _ : state)
+  {
+    auto frame = lobot_protocol::encode(request);
+    benchmark::DoNotOptimize(frame);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Parameters of a position reply of all servos
+std::array<std::uint8_t, 1 + 3 * SERVO_NUM> makeServoPositionsParams()
+{
+  std::array<std::uint8_t, 1 + 3 * SERVO_NUM> params;
+  params[0] = SERVO_NUM;
+  for (std::size_t i = 0; i != SERVO_NUM; ++i)
+  {
+    const auto position = static_cast<std::uint16_t>(400 + 40 * i);
+    params[1 + 3 * i] = static_cast<std::uint8_t>(i + 1);
+    lobot_protocol::encodeUint16(position, params.data() + 2 + 3 * i);
+  }
+  return params;
+}
+
+void decodeServoPositionsReply(benchmark::State& state)
+{
+  const auto params = makeServoPositionsParams();
+  std::array<std::uint16_t, SERVO_NUM> positions;
+  for (auto _ : state)
+  {
+    lobot_protocol::ServoPositionsReply reply;
+    if (reply.decode(params.data(), params.size()))
+    {
+      for (std::size_t i = 0; i != reply.getServoNum(); ++i)
+      {
+        positions[reply.getId(i) - 1] = reply.getPosition(i);
+      }
+    }
+    benchmark::DoNotOptimize(positions);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// A position reply in a zero-padded 64-byte report through FrameParser, as MyHid::poll() receives it
+void parseServoPositionsReport(benchmark::State& state)
+{
+  const auto params = makeServoPositionsParams();
+  std::array<std::uint8_t, 64> report{};
+  report[0] = FRAME_HEADER;
+  report[1] = FRAME_HEADER;
+  report[2] = static_cast<std::uint8_t>(lobot_protocol::MIN_LENGTH + params.size());
+  report[3] = lobot_protocol::CMD_MULT_SERVO_POS_READ;
+  std::copy(params.begin(), params.end(), report.begin() + lobot_protocol::HEADER_SIZE);
+
+  FrameParser frame_parser;
+  std::uint16_t position = 0;
+  frame_parser.setCallback(lobot_protocol::CMD_MULT_SERVO_POS_READ, [&](const unsigned char* params, size_t size) {
+    lobot_protocol::ServoPositionsReply reply;
+    if (reply.decode(params, size))
+    {
+      position = reply.getPosition(0);
+    }
+  });
+  for (auto _ : state)
+  {
+    frame_parser.feed(report.data(), report.size());
+    benchmark::DoNotOptimize(position);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * report.size());
+}
+
+}  // namespace
+
+BENCHMARK(encodeMultServoSpin)->Name("LobotProtocol/encode/MultServoSpin");
+BENCHMARK(encodeMultServoPosRead)->Name("LobotProtocol/encode/MultServoPosRead");
+BENCHMARK(decodeServoPositionsReply)->Name("LobotProtocol/decode/ServoPositionsReply");
+BENCHMARK(parseServoPositionsReport)->Name("LobotProtocol/parse/ServoPositionsReport");
+
+BENCHMARK_MAIN();
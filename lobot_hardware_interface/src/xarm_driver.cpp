@@ -1,7 +1,15 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
 #include "xarm_driver/xarm_driver.h"
 
 namespace lobot_hardware_interface
 {
+constexpr int XarmDriver::READ_TIMEOUT_MS;
+constexpr int XarmDriver::POLL_TIMEOUT_MS;
+constexpr double XarmDriver::MAX_EXTRAPOLATION;
+
 XarmDriver::XarmDriver()
 {
   my_hid_ = MyHid(0x0483, 0x5750);
@@ -13,23 +21,121 @@ XarmDriver::XarmDriver()
   {
     ROS_ERROR_NAMED("xarm_hardware_interface", err.what());
     ros::shutdown();
+    return;
   }
 
   ROS_INFO_NAMED("xarm_hardware_interface", "xArm control board connected");
 
+  my_hid_.setFrameCallback(lobot_protocol::CMD_MULT_SERVO_POS_READ, [this](const unsigned char* params, size_t size) {
+    receiveServoPositions(params, size);
+  });
+
   init();
+
+  io_running_ = true;
+  io_thread_ = std::thread(&XarmDriver::ioLoop, this);
 }
 
 XarmDriver::~XarmDriver()
 {
+  io_running_ = false;
+  if (io_thread_.joinable())
+  {
+    io_thread_.join();
+  }
   my_hid_.close();
 }
 
 void XarmDriver::init()
 {
-  spinServos({ 1, 2, 3, 4, 5, 6 }, { 200, 500, 500, 500, 500, 500 });
+  spinServos<SERVO_NUM>({ 1, 2, 3, 4, 5, 6 }, { 200, 500, 500, 500, 500, 500 });
   ros::Duration(2).sleep();
   ROS_INFO_NAMED("xarm_hardware_interface", "Arm joints initialized");
+
+  // Joint states are valid from the first control cycle on
+  ServoState servo_state;
+  requestServoPositions();
+  if (readServoPositions(servo_state.positions, READ_TIMEOUT_MS))
+  {
+    servo_state.stamp = ros::Time::now();
+    servo_states_.write(servo_state);
+  }
+  else
+  {
+    ROS_WARN_NAMED("xarm_hardware_interface", "No servo positions after initialization");
+  }
+}
+
+// Sends each new command once followed by a position request, and collects the reply while waiting for the next
+// command. A new command is sent even if the reply is still pending, without another request.
+void XarmDriver::ioLoop()
+{
+  ServoCommand servo_command;
+  ServoState servo_state;
+  auto request_pending = false;
+  ros::Time command_time, request_time;
+
+  // Time from a command to the reply of its position request, i.e. of a transaction
+  std::uint64_t transaction_num = 0;
+  double transaction_time_sum = 0;
+  double max_transaction_time = 0;
+
+  while (io_running_)
+  {
+    if (servo_commands_.read(servo_command))
+    {
+      const auto& positions = servo_command.positions;
+      const auto spin_time = ros::Time::now();
+      spinServos<JOINT_NUM>({ 2, 3, 4, 5, 6 },
+                            { positions[4], positions[3], positions[2], positions[1], positions[0] },
+                            servo_command.period);
+      spinServos<1>({ 1 }, { positions[GRIPPER_ID] }, 600);
+      if (!request_pending)
+      {
+        command_time = spin_time;
+        request_time = ros::Time::now();
+        requestServoPositions();
+        request_pending = true;
+      }
+    }
+
+    if (!request_pending)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT_MS));
+      continue;
+    }
+
+    if (readServoPositions(servo_state.positions, POLL_TIMEOUT_MS))
+    {
+      const auto reply_time = ros::Time::now();
+      servo_state.stamp = request_time + (reply_time - request_time) * 0.5;
+      servo_states_.write(servo_state);
+      request_pending = false;
+
+      const auto transaction_time = (reply_time - command_time).toSec();
+      ++transaction_num;
+      transaction_time_sum += transaction_time;
+      max_transaction_time = std::max(max_transaction_time, transaction_time);
+    }
+    else if ((ros::Time::now() - request_time).toSec() * 1000 > READ_TIMEOUT_MS)
+    {
+      ROS_WARN_THROTTLE_NAMED(1, "xarm_hardware_interface", "No reply to servo position request");
+      my_hid_.discardPartialFrame();
+      request_pending = false;
+    }
+  }
+
+  if (transaction_num)
+  {
+    ROS_INFO_NAMED("xarm_hardware_interface", "%lu transactions with the control board, mean %.3f ms, max %.3f ms",
+                   static_cast<unsigned long>(transaction_num), transaction_time_sum / transaction_num * 1e3,
+                   max_transaction_time * 1e3);
+  }
+  const auto& frame_parser = my_hid_.getFrameParser();
+  ROS_INFO_NAMED("xarm_hardware_interface", "%lu frames from the control board, %lu unhandled, %lu of invalid length",
+                 static_cast<unsigned long>(frame_parser.getFrameNum()),
+                 static_cast<unsigned long>(frame_parser.getUnhandledFrameNum()),
+                 static_cast<unsigned long>(frame_parser.getInvalidLengthNum()));
 }
 
 }  // namespace lobot_hardware_interface
@@ -33,13 +33,31 @@ XarmHardwareInterface::XarmHardwareInterface(ros::NodeHandle& nh)
   registerInterface(&joint_state_interface_);
   registerInterface(&position_joint_interface_);
 
-  timer = nh.createTimer(ros::Duration(0.1), &lobot_hardware_interface::XarmHardwareInterface::update, this);
+  // Control loop, priority 0 and CPU -1 keep the default schedule
+  ros::NodeHandle hardware_interface_nh(nh, "xarm/hardware_interface");
+  double control_rate;
+  int control_priority, control_cpu;
+  hardware_interface_nh.param("control_rate", control_rate, 50.0);
+  hardware_interface_nh.param("control_priority", control_priority, 0);
+  hardware_interface_nh.param("control_cpu", control_cpu, -1);
+  if (!(control_rate > 0))
+  {
+    ROS_WARN_NAMED("xarm_hardware_interface", "Invalid control rate %f, using 50 Hz", control_rate);
+    control_rate = 50.0;
+  }
+  control_loop_.reset(new ControlLoop(control_rate, control_priority, control_cpu,
+                                      [this](const ros::Time& time, const ros::Duration& period) {
+                                        update(time, period);
+                                      }));
+  control_loop_->start();
+  ROS_INFO_NAMED("xarm_hardware_interface", "Control loop running at %.1f Hz", control_rate);
 
   gripper_cmd_action_server_.start();
 }
 
 XarmHardwareInterface::~XarmHardwareInterface()
 {
+  control_loop_->stop();
 }
 
 void XarmHardwareInterface::gripperCmdCallback(const control_msgs::GripperCommandGoalConstPtr& goal)
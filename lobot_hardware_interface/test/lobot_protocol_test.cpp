@@ -0,0 +1,274 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "hid/frame_parser.hpp"
+#include "hid/lobot_protocol.hpp"
+
+namespace
+{
+constexpr int FRAME_NUM = 1000;
+constexpr std::size_t REPORT_SIZE = 64;
+
+// A frame as sent or received, its command and parameters
+struct Frame
+{
+  std::uint8_t cmd;
+  std::vector<std::uint8_t> params;
+
+  bool operator==(const Frame& other) const
+  {
+    return cmd == other.cmd && params == other.params;
+  }
+};
+
+std::vector<std::uint8_t> serialize(const Frame& frame)
+{
+  std::vector<std::uint8_t> bytes{ FRAME_HEADER, FRAME_HEADER,
+                                   static_cast<std::uint8_t>(lobot_protocol::MIN_LENGTH + frame.params.size()),
+                                   frame.cmd };
+  bytes.insert(bytes.end(), frame.params.begin(), frame.params.end());
+  return bytes;
+}
+
+// Position reply of random servos, as the board sends it
+Frame makeServoPositionsFrame(std::mt19937& generator)
+{
+  const auto servo_num = 1 + generator() % ((lobot_protocol::MAX_LENGTH - lobot_protocol::MIN_LENGTH - 1) / 3);
+  Frame frame{ lobot_protocol::CMD_MULT_SERVO_POS_READ, std::vector<std::uint8_t>(1 + 3 * servo_num) };
+  frame.params[0] = static_cast<std::uint8_t>(servo_num);
+  for (std::size_t i = 0; i != servo_num; ++i)
+  {
+    frame.params[1 + 3 * i] = static_cast<std::uint8_t>(generator());
+    lobot_protocol::encodeUint16(static_cast<std::uint16_t>(generator()), frame.params.data() + 2 + 3 * i);
+  }
+  return frame;
+}
+
+// Any command with parameters of any valid length
+Frame makeRandomFrame(std::mt19937& generator)
+{
+  Frame frame{ static_cast<std::uint8_t>(generator()),
+               std::vector<std::uint8_t>(generator() % (lobot_protocol::MAX_LENGTH - lobot_protocol::MIN_LENGTH + 1)) };
+  for (auto& param : frame.params)
+  {
+    param = static_cast<std::uint8_t>(generator());
+  }
+  return frame;
+}
+
+// Bytes between frames that never form a header
+std::vector<std::uint8_t> makeNoise(std::mt19937& generator)
+{
+  std::vector<std::uint8_t> noise(generator() % 16);
+  for (auto& byte : noise)
+  {
+    do
+    {
+      byte = static_cast<std::uint8_t>(generator());
+    } while (byte == FRAME_HEADER);
+  }
+  return noise;
+}
+
+// Records the frames of every command
+class FrameParserTest : public ::testing::Test
+{
+protected:
+  FrameParser frame_parser_;
+  std::vector<Frame> received_;
+  std::mt19937 generator_{ 0 };
+
+  void SetUp() override
+  {
+    for (unsigned cmd = 0; cmd != 256; ++cmd)
+    {
+      frame_parser_.setCallback(cmd, [this, cmd](const unsigned char* params, size_t size) {
+        received_.push_back(Frame{ static_cast<std::uint8_t>(cmd), std::vector<std::uint8_t>(params, params + size) });
+      });
+    }
+  }
+
+  // Feeds bytes in chunks of random sizes up to max_chunk_size
+  void feedSplit(const std::vector<std::uint8_t>& bytes, std::size_t max_chunk_size)
+  {
+    for (std::size_t i = 0; i < bytes.size();)
+    {
+      const auto size = std::min<std::size_t>(bytes.size() - i, generator_() % (max_chunk_size + 1));
+      frame_parser_.feed(bytes.data() + i, size);
+      i += size;
+    }
+  }
+};
+
+TEST(LobotProtocol, EncodesMultServoSpin)
+{
+  const lobot_protocol::MultServoSpin<2> spin{ 1000, { 1, 6 }, { 500, 0x3FF } };
+  const auto frame = lobot_protocol::encode(spin);
+  const std::array<std::uint8_t, 13> expected{ 0x55, 0x55, 11, 3, 2, 0xE8, 0x03, 1, 0xF4, 0x01, 6, 0xFF, 0x03 };
+  EXPECT_EQ(expected, frame);
+}
+
+TEST(LobotProtocol, EncodesMultServoPosRead)
+{
+  const lobot_protocol::MultServoPosRead<3> request{ { 1, 2, 3 } };
+  const auto frame = lobot_protocol::encode(request);
+  const std::array<std::uint8_t, 8> expected{ 0x55, 0x55, 6, 21, 3, 1, 2, 3 };
+  EXPECT_EQ(expected, frame);
+}
+
+TEST(LobotProtocol, RejectsServoPositionsOfWrongSize)
+{
+  std::mt19937 generator(0);
+  const auto frame = makeServoPositionsFrame(generator);
+  lobot_protocol::ServoPositionsReply reply;
+  EXPECT_FALSE(reply.decode(frame.params.data(), 0));
+  EXPECT_FALSE(reply.decode(frame.params.data(), frame.params.size() - 1));
+  EXPECT_EQ(0u, reply.getServoNum());
+  EXPECT_TRUE(reply.decode(frame.params.data(), frame.params.size()));
+  EXPECT_EQ(frame.params[0], reply.getServoNum());
+}
+
+// Encoded requests and random replies come out of the parser and the decoder as they went in
+TEST_F(FrameParserTest, RoundTripsFrames)
+{
+  std::vector<Frame> sent;
+  for (auto i = 0; i < FRAME_NUM; ++i)
+  {
+    const auto frame = makeServoPositionsFrame(generator_);
+    const auto bytes = serialize(frame);
+    frame_parser_.feed(bytes.data(), bytes.size());
+    sent.push_back(frame);
+
+    ASSERT_EQ(sent.size(), received_.size());
+    const auto& params = received_.back().params;
+    lobot_protocol::ServoPositionsReply reply;
+    ASSERT_TRUE(reply.decode(params.data(), params.size()));
+    ASSERT_EQ(frame.params[0], reply.getServoNum());
+    for (std::size_t j = 0; j != reply.getServoNum(); ++j)
+    {
+      EXPECT_EQ(frame.params[1 + 3 * j], reply.getId(j));
+      EXPECT_EQ(lobot_protocol::decodeUint16(frame.params.data() + 2 + 3 * j), reply.getPosition(j));
+    }
+  }
+
+  const lobot_protocol::MultServoSpin<5> spin{ 20, { 2, 3, 4, 5, 6 }, { 0, 250, 500, 750, 1000 } };
+  const auto spin_frame = lobot_protocol::encode(spin);
+  frame_parser_.feed(spin_frame.data(), spin_frame.size());
+  const Frame expected{ lobot_protocol::CMD_MULT_SERVO_SPIN,
+                        std::vector<std::uint8_t>(spin_frame.begin() + lobot_protocol::HEADER_SIZE, spin_frame.end()) };
+  sent.push_back(expected);
+
+  EXPECT_EQ(sent, received_);
+  EXPECT_EQ(sent.size(), frame_parser_.getFrameNum());
+  EXPECT_EQ(0u, frame_parser_.getUnhandledFrameNum());
+}
+
+// Bytes between frames, including runs of the header byte, are skipped
+TEST_F(FrameParserTest, SkipsNoise)
+{
+  std::vector<Frame> sent;
+  std::vector<std::uint8_t> bytes;
+  for (auto i = 0; i < FRAME_NUM; ++i)
+  {
+    const auto noise = makeNoise(generator_);
+    bytes.insert(bytes.end(), noise.begin(), noise.end());
+    bytes.insert(bytes.end(), generator_() % 4, FRAME_HEADER);
+
+    sent.push_back(makeRandomFrame(generator_));
+    const auto frame_bytes = serialize(sent.back());
+    bytes.insert(bytes.end(), frame_bytes.begin(), frame_bytes.end());
+  }
+  frame_parser_.feed(bytes.data(), bytes.size());
+
+  EXPECT_EQ(sent, received_);
+}
+
+// Frames split across any chunks arrive whole
+TEST_F(FrameParserTest, JoinsSplitFrames)
+{
+  std::vector<Frame> sent;
+  std::vector<std::uint8_t> bytes;
+  for (auto i = 0; i < FRAME_NUM; ++i)
+  {
+    sent.push_back(makeRandomFrame(generator_));
+    const auto frame_bytes = serialize(sent.back());
+    bytes.insert(bytes.end(), frame_bytes.begin(), frame_bytes.end());
+  }
+  feedSplit(bytes, 1);
+  feedSplit(bytes, 7);
+  feedSplit(bytes, 300);
+
+  std::vector<Frame> expected;
+  for (auto i = 0; i < 3; ++i)
+  {
+    expected.insert(expected.end(), sent.begin(), sent.end());
+  }
+  EXPECT_EQ(expected, received_);
+  EXPECT_EQ(0u, frame_parser_.getInvalidLengthNum());
+}
+
+// Zero-padded HID reports with a frame each, as the board sends them
+TEST_F(FrameParserTest, SkipsReportPadding)
+{
+  std::vector<Frame> sent;
+  for (auto i = 0; i < FRAME_NUM; ++i)
+  {
+    sent.push_back(makeServoPositionsFrame(generator_));
+    auto report = serialize(sent.back());
+    ASSERT_LE(report.size(), REPORT_SIZE);
+    report.resize(REPORT_SIZE, 0);
+    frame_parser_.feed(report.data(), report.size());
+  }
+
+  EXPECT_EQ(sent, received_);
+}
+
+// A frame whose rest is lost is dropped by reset(), the next frame arrives whole
+TEST_F(FrameParserTest, DropsTruncatedFrames)
+{
+  std::vector<Frame> sent;
+  for (auto i = 0; i < FRAME_NUM; ++i)
+  {
+    const auto truncated = serialize(makeServoPositionsFrame(generator_));
+    frame_parser_.feed(truncated.data(), 1 + generator_() % (truncated.size() - 1));
+    EXPECT_EQ(sent.size(), received_.size());
+    frame_parser_.reset();
+
+    sent.push_back(makeServoPositionsFrame(generator_));
+    const auto bytes = serialize(sent.back());
+    frame_parser_.feed(bytes.data(), bytes.size());
+  }
+
+  EXPECT_EQ(sent, received_);
+}
+
+// Lengths that no frame of the board has are counted and skipped
+TEST_F(FrameParserTest, SkipsInvalidLengths)
+{
+  const std::vector<std::uint8_t> bytes{ FRAME_HEADER, FRAME_HEADER, 1, FRAME_HEADER, FRAME_HEADER,
+                                         lobot_protocol::MAX_LENGTH + 1 };
+  frame_parser_.feed(bytes.data(), bytes.size());
+  EXPECT_EQ(2u, frame_parser_.getInvalidLengthNum());
+
+  const Frame frame{ lobot_protocol::CMD_GET_BATTERY_VOLTAGE, { 0x10, 0x1F } };
+  const auto frame_bytes = serialize(frame);
+  frame_parser_.feed(frame_bytes.data(), frame_bytes.size());
+  ASSERT_EQ(1u, received_.size());
+  EXPECT_EQ(frame, received_[0]);
+
+  lobot_protocol::BatteryVoltageReply reply;
+  ASSERT_TRUE(reply.decode(received_[0].params.data(), received_[0].params.size()));
+  EXPECT_EQ(0x1F10, reply.getVoltage());
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
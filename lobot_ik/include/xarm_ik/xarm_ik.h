@@ -16,6 +16,14 @@ class XArmIk {
   bool SetPoseTarget(geometry_msgs::Pose pose,
                      moveit::planning_interface::MoveGroupInterface& group);
 
+  // Closed-form IK of the pose without a move group, the solution is kept
+  // for GetJointValues()
+  bool SolveIk(const geometry_msgs::Pose& pose);
+
+  const std::array<double, JOINT_NUM>& GetJointValues() const {
+    return jointValueVec_;
+  }
+
  private:
   std::array<double, JOINT_NUM> jointValueVec_;
 
@@ -23,7 +31,6 @@ class XArmIk {
   bool RevisePose(geometry_msgs::Pose& pose);
   void QuaternionToRPY(const geometry_msgs::Quaternion& q, double& roll,
                        double& pitch, double& yaw);
-  bool SolveIk(const geometry_msgs::Point& p, tf::Matrix3x3& r);
 };
 
 inline bool XArmIk::IsPoseReachable(const geometry_msgs::Pose& pose) {
@@ -0,0 +1,62 @@
+#include <benchmark/benchmark.h>
+#include <ros/console.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "xarm_ik/xarm_ik.h"
+#include "xarm_kinematics_plugin/benchmark_poses.h"
+
+namespace benchmark_poses = xarm_kinematics_plugin::benchmark_poses;
+
+namespace {
+
+constexpr int poseNum = 1000;
+
+std::vector<geometry_msgs::Pose> poseSets[benchmark_poses::POSE_SET_NUM];
+
+// XArmIk::SolveIk() of the pose sets of xarm_kinematics_benchmark_suite, one
+// pose per iteration
+void SolveIk(benchmark::State& state) {
+  const auto& poses = poseSets[state.range(0)];
+  lobot_ik::XArmIk xArmIk;
+  std::int64_t solvedNum = 0;
+  std::size_t i = 0;
+  for (auto _ : state) {
+    solvedNum += xArmIk.SolveIk(poses[i++ % poses.size()]);
+    benchmark::DoNotOptimize(xArmIk.GetJointValues());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["solved"] =
+      static_cast<double>(solvedNum) / state.iterations();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // E.g. --benchmark_out=<file> --benchmark_out_format=json for tracking the
+  // results
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  // Unreachable poses are expected, keep their errors out of the results
+  if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME ".xarm_ik",
+                                     ros::console::levels::Fatal)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  for (int poseSet = 0; poseSet < benchmark_poses::POSE_SET_NUM; ++poseSet) {
+    const auto set = static_cast<benchmark_poses::PoseSet>(poseSet);
+    poseSets[poseSet] = benchmark_poses::generatePoses(set, poseNum);
+    benchmark::RegisterBenchmark(
+        (std::string("XArmIk/SolveIk/") + benchmark_poses::getPoseSetName(set))
+            .c_str(),
+        SolveIk)
+        ->Arg(poseSet);
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,38 @@
+# Generates xarm_kinematics_plugin/xarm_geometry.h with the joint origins of the xArm chain in the URDF, so the
+# kinematics kernels keep constant-folding the link lengths while the robot description stays the source of truth.
+#
+#   xarm_generate_geometry(<urdf> <output_header>)
+
+set(XARM_GEOMETRY_TEMPLATE "${CMAKE_CURRENT_LIST_DIR}/xarm_geometry.h.in")
+
+function(xarm_generate_geometry urdf output_header)
+  file(READ "${urdf}" urdf_content)
+
+  # The closed-form IK assumes the chain below, any other offset is an error
+  foreach(joint arm_joint1 arm_joint2 arm_joint3 arm_joint4 arm_joint5 arm_to_gripper)
+    string(REGEX MATCH "<joint name=\"${joint}\"[^>]*>[^<]*<origin[^>]*xyz=\"([^\"]*)\"" joint_match "${urdf_content}")
+    if(NOT joint_match)
+      message(FATAL_ERROR "No origin of ${joint} in ${urdf}")
+    endif()
+
+    set(origin "${CMAKE_MATCH_1}")
+    string(REGEX REPLACE "[ \t]+" ";" xyz "${origin}")
+    list(GET xyz 0 x)
+    list(GET xyz 1 y)
+    list(GET xyz 2 z)
+    set(zero_regex "^[-+]?0*\\.?0*(e[-+]?[0-9]+)?$")
+    if(NOT y MATCHES "${zero_regex}" OR (NOT x MATCHES "${zero_regex}" AND NOT joint STREQUAL "arm_joint2"))
+      message(FATAL_ERROR "Unexpected origin \"${origin}\" of ${joint} in ${urdf}")
+    endif()
+
+    string(TOUPPER "${joint}" joint_upper)
+    set(XARM_${joint_upper}_X "${x}")
+    set(XARM_${joint_upper}_Z "${z}")
+  endforeach()
+
+  set(XARM_URDF "${urdf}")
+  configure_file("${XARM_GEOMETRY_TEMPLATE}" "${output_header}" @ONLY)
+
+  # Configure again when the URDF changes
+  set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS "${urdf}")
+endfunction()
@@ -0,0 +1,222 @@
+#ifndef XARM_KINEMATICS_PLUGIN_BENCHMARK_POSES_H
+#define XARM_KINEMATICS_PLUGIN_BENCHMARK_POSES_H
+
+#include <geometry_msgs/Pose.h>
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "xarm_kinematics_plugin/xarm_kinematics_core.h"
+
+namespace xarm_kinematics_plugin
+{
+// Pose sets of the benchmark suites of lobot_kinematics and lobot_ik, generated from a fixed seed so that the results
+// of different commits compare
+namespace benchmark_poses
+{
+enum PoseSet
+{
+  UNIFORM,        // Tool poses of joint values uniform within the limits
+  NEAR_SINGULAR,  // Within 1e-4 of the stretched elbow, the vertical tool axis or the wrist on the Z axis
+  UNREACHABLE,    // Beyond the reach of the arm, or with the tool axis out of the plane of the arm
+  DEMO,           // Fixed targets of the demo programs
+  POSE_SET_NUM
+};
+
+typedef XarmKinematicsCore<double> Kinematics;
+
+// Joint limits of xarm.urdf
+constexpr double lower_limits[JOINT_NUM] = { -2.09439510239, -1.57079632679, -2.09439510239, -2.09439510239,
+                                             -2.09439510239 };
+constexpr double upper_limits[JOINT_NUM] = { 2.09439510239, 1.57079632679, 2.09439510239, 2.09439510239,
+                                             2.09439510239 };
+
+constexpr double singular_offset = 1e-4;
+
+inline const char* getPoseSetName(PoseSet pose_set)
+{
+  switch (pose_set)
+  {
+    case UNIFORM:
+      return "uniform";
+    case NEAR_SINGULAR:
+      return "near_singular";
+    case UNREACHABLE:
+      return "unreachable";
+    case DEMO:
+      return "demo";
+    default:
+      return "unknown";
+  }
+}
+
+inline bool isWithinLimits(const Kinematics::JointValues& joint_values)
+{
+  for (auto i = 0; i < JOINT_NUM; ++i)
+  {
+    // NaN fails both comparisons
+    if (!(joint_values[i] >= lower_limits[i] && joint_values[i] <= upper_limits[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline geometry_msgs::Pose computeToolPose(const Kinematics::JointValues& joint_values)
+{
+  std::array<double, 3> position;
+  std::array<double, 4> orientation;
+  Kinematics::computeToolPose(joint_values.data(), position, orientation);
+
+  geometry_msgs::Pose pose;
+  pose.position.x = position[0];
+  pose.position.y = position[1];
+  pose.position.z = position[2];
+  pose.orientation.x = orientation[0];
+  pose.orientation.y = orientation[1];
+  pose.orientation.z = orientation[2];
+  pose.orientation.w = orientation[3];
+  return pose;
+}
+
+// Whether the tool pose of joint_values is pose, to within tolerance in meters and twice it in radians
+inline bool isSolutionOf(const Kinematics::JointValues& joint_values, const geometry_msgs::Pose& pose,
+                         double tolerance = 1e-5)
+{
+  const auto tool_pose = computeToolPose(joint_values);
+  const auto& p = tool_pose.orientation;
+  const auto& q = pose.orientation;
+  const auto dot = p.x * q.x + p.y * q.y + p.z * q.z + p.w * q.w;
+
+  // q and -q are the same orientation, |p -+ q|^2 = 2 - 2 |dot| for unit quaternions
+  return std::abs(tool_pose.position.x - pose.position.x) <= tolerance &&
+         std::abs(tool_pose.position.y - pose.position.y) <= tolerance &&
+         std::abs(tool_pose.position.z - pose.position.z) <= tolerance &&
+         2 - 2 * std::abs(dot) <= tolerance * tolerance;
+}
+
+inline geometry_msgs::Pose makePose(double x, double y, double z, double roll, double pitch, double yaw)
+{
+  geometry_msgs::Pose pose;
+  pose.position.x = x;
+  pose.position.y = y;
+  pose.position.z = z;
+  Kinematics::rpyToQuaternion(roll, pitch, yaw, pose.orientation.x, pose.orientation.y, pose.orientation.z,
+                              pose.orientation.w);
+  return pose;
+}
+
+// Targets of lobot_demo and of the demos of lobot_ik, including the waypoints of xarm_trajectory_plan
+inline std::vector<geometry_msgs::Pose> getDemoPoses()
+{
+  std::vector<geometry_msgs::Pose> poses{
+    makePose(0.1, 0, 0.15, M_PI / 6, M_PI / 4, 0),
+    makePose(0.25, 0, 0.15, M_PI / 6, M_PI / 4, 0),
+    makePose(0.22, 0, 0.04, 0, 0, 0),
+    makePose(0, 0.18, 0.05, 0, M_PI / 4, M_PI / 2),
+    makePose(0.1, -0.05, 0.1, 0, M_PI / 4, 0),
+    makePose(0.04, 0.05, 0.1, M_PI / 6, 3 * M_PI / 4, M_PI / 3),
+    makePose(0.04, 0, 0.1, 0, 3 * M_PI / 4, M_PI / 3),
+  };
+  for (double th = 0; th < M_PI_2; th += 0.04)
+  {
+    poses.push_back(makePose(0.13 + 0.02 * std::cos(th), 0, 0.16 + 0.02 * std::sin(th), 0, M_PI / 6, 0));
+  }
+  return poses;
+}
+
+// pose_num poses of the set, the demo set has a fixed size
+inline std::vector<geometry_msgs::Pose> generatePoses(PoseSet pose_set, int pose_num, unsigned seed = 0)
+{
+  using geometry::a1;
+  using geometry::a2;
+  using geometry::a3;
+  using geometry::base_height;
+  using geometry::tool_length;
+
+  if (pose_set == DEMO)
+  {
+    return getDemoPoses();
+  }
+
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+  const auto sample_joint_values = [&](Kinematics::JointValues& joint_values) {
+    for (auto i = 0; i < JOINT_NUM; ++i)
+    {
+      joint_values[i] = lower_limits[i] + (upper_limits[i] - lower_limits[i]) * unit(generator);
+    }
+  };
+
+  std::vector<geometry_msgs::Pose> poses;
+  poses.reserve(pose_num);
+  Kinematics::JointValues joint_values;
+  while (static_cast<int>(poses.size()) < pose_num)
+  {
+    const auto kind = poses.size() % 3;
+    sample_joint_values(joint_values);
+    switch (pose_set)
+    {
+      case UNIFORM:
+        break;
+      case NEAR_SINGULAR:
+        if (kind == 0)
+        {
+          // Stretched elbow, i.e. at the boundary of the workspace of the wrist
+          joint_values[2] = std::copysign(singular_offset, joint_values[2]);
+        }
+        else if (kind == 1)
+        {
+          // Tool axis vertical, theta1 and theta5 turn about nearly the same axis
+          const auto phi = (joint_values[1] + joint_values[2] + joint_values[3] > M_PI_2) ? M_PI : 0.0;
+          joint_values[3] = phi + singular_offset - joint_values[1] - joint_values[2];
+        }
+        else
+        {
+          // Wrist on the Z axis, a2 sin(theta2) + a3 sin(theta2 + theta3) = singular_offset - a1
+          const auto s23 = (singular_offset - a1 - a2 * std::sin(joint_values[1])) / a3;
+          joint_values[2] = std::asin(s23) - joint_values[1];
+        }
+        if (!isWithinLimits(joint_values))
+        {
+          continue;
+        }
+        break;
+      case UNREACHABLE:
+        if (kind == 0)
+        {
+          // A reachable position with the tool axis turned out of the plane of the arm
+          const auto pose = computeToolPose(joint_values);
+          double roll, pitch, yaw;
+          Kinematics::quaternionToRpy(pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w,
+                                      roll, pitch, yaw);
+          poses.push_back(makePose(pose.position.x, pose.position.y, pose.position.z, roll, pitch, yaw + 0.5));
+        }
+        else
+        {
+          // Positions beyond the reach of the tool point from arm_joint2 in any direction and orientation
+          const auto max_reach = a1 + a2 + a3 + tool_length;
+          const auto distance = max_reach * (1.2 + unit(generator));
+          const auto z = 2 * unit(generator) - 1;
+          const auto azimuth = angle(generator);
+          const auto rho = std::sqrt(1 - z * z);
+          poses.push_back(makePose(distance * rho * std::cos(azimuth), distance * rho * std::sin(azimuth),
+                                   base_height + distance * z, angle(generator), angle(generator) / 2,
+                                   angle(generator)));
+        }
+        continue;
+      default:
+        return poses;
+    }
+    poses.push_back(computeToolPose(joint_values));
+  }
+  return poses;
+}
+
+}  // namespace benchmark_poses
+}  // namespace xarm_kinematics_plugin
+
+#endif  // XARM_KINEMATICS_PLUGIN_BENCHMARK_POSES_H
@@ -0,0 +1,190 @@
+#ifndef XARM_KINEMATICS_PLUGIN_IK_CACHE_H
+#define XARM_KINEMATICS_PLUGIN_IK_CACHE_H
+
+#include <geometry_msgs/Pose.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace xarm_kinematics_plugin
+{
+// Pose rounded to a grid, the position in multiples of the position resolution and the quaternion in multiples of the
+// orientation resolution
+struct PoseKey
+{
+  std::array<std::int64_t, 7> cells;
+
+  bool operator==(const PoseKey& other) const
+  {
+    return cells == other.cells;
+  }
+};
+
+struct PoseKeyHash
+{
+  std::size_t operator()(const PoseKey& key) const
+  {
+    std::uint64_t hash = 14695981039346656037ull;  // FNV-1a over the cells
+    for (const auto cell : key.cells)
+    {
+      hash = (hash ^ static_cast<std::uint64_t>(cell)) * 1099511628211ull;
+    }
+    return static_cast<std::size_t>(hash);
+  }
+};
+
+// LRU cache of IK results keyed on the quantized pose. The entries are split over STRIPE_NUM independently locked
+// stripes on cache lines of their own, so concurrent planners rarely wait for each other. The hits and misses are
+// counted by stripe as well. Lookups that hit do not allocate.
+template <typename Value>
+class IkCache
+{
+public:
+  static constexpr std::size_t STRIPE_NUM = 16;
+
+  IkCache(std::size_t capacity, double position_resolution, double orientation_resolution)
+    : stripe_capacity_((capacity + STRIPE_NUM - 1) / STRIPE_NUM)
+    , position_resolution_(position_resolution)
+    , orientation_resolution_(orientation_resolution)
+  {
+    for (auto& stripe : stripes_)
+    {
+      stripe.index.reserve(stripe_capacity_);
+      stripe.hit_num = 0;
+      stripe.miss_num = 0;
+    }
+  }
+
+  PoseKey makeKey(const geometry_msgs::Pose& pose) const
+  {
+    // q and -q are the same rotation
+    const auto sign = pose.orientation.w < 0 ? -1.0 : 1.0;
+
+    PoseKey key;
+    key.cells[0] = std::llround(pose.position.x / position_resolution_);
+    key.cells[1] = std::llround(pose.position.y / position_resolution_);
+    key.cells[2] = std::llround(pose.position.z / position_resolution_);
+    key.cells[3] = std::llround(sign * pose.orientation.x / orientation_resolution_);
+    key.cells[4] = std::llround(sign * pose.orientation.y / orientation_resolution_);
+    key.cells[5] = std::llround(sign * pose.orientation.z / orientation_resolution_);
+    key.cells[6] = std::llround(sign * pose.orientation.w / orientation_resolution_);
+    return key;
+  }
+
+  // Copies the cached value of the key into value and marks it as the most recently used, returns false on a miss
+  bool find(const PoseKey& key, Value& value)
+  {
+    const auto hash = PoseKeyHash()(key);
+    auto& stripe = stripes_[hash % STRIPE_NUM];
+
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    const auto it = stripe.index.find(key);
+    if (it == stripe.index.end())
+    {
+      stripe.miss_num.store(stripe.miss_num.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    stripe.entries.splice(stripe.entries.begin(), stripe.entries, it->second);
+    value = it->second->second;
+    stripe.hit_num.store(stripe.hit_num.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Adds or replaces the value of the key, evicting the least recently used entry of a full stripe
+  void insert(const PoseKey& key, const Value& value)
+  {
+    const auto hash = PoseKeyHash()(key);
+    auto& stripe = stripes_[hash % STRIPE_NUM];
+
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    const auto it = stripe.index.find(key);
+    if (it != stripe.index.end())
+    {
+      it->second->second = value;
+      stripe.entries.splice(stripe.entries.begin(), stripe.entries, it->second);
+      return;
+    }
+
+    if (stripe.index.size() >= stripe_capacity_)
+    {
+      // Reuse the node of the evicted entry
+      stripe.index.erase(stripe.entries.back().first);
+      stripe.entries.splice(stripe.entries.begin(), stripe.entries, std::prev(stripe.entries.end()));
+      stripe.entries.front().first = key;
+      stripe.entries.front().second = value;
+    }
+    else
+    {
+      stripe.entries.emplace_front(key, value);
+    }
+    stripe.index.emplace(key, stripe.entries.begin());
+  }
+
+  void clear()
+  {
+    for (auto& stripe : stripes_)
+    {
+      std::lock_guard<std::mutex> lock(stripe.mutex);
+      stripe.index.clear();
+      stripe.entries.clear();
+      stripe.hit_num = 0;
+      stripe.miss_num = 0;
+    }
+  }
+
+  std::uint64_t getHitNum() const
+  {
+    std::uint64_t hit_num = 0;
+    for (const auto& stripe : stripes_)
+    {
+      hit_num += stripe.hit_num.load(std::memory_order_relaxed);
+    }
+    return hit_num;
+  }
+
+  std::uint64_t getMissNum() const
+  {
+    std::uint64_t miss_num = 0;
+    for (const auto& stripe : stripes_)
+    {
+      miss_num += stripe.miss_num.load(std::memory_order_relaxed);
+    }
+    return miss_num;
+  }
+
+private:
+  static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+  typedef std::list<std::pair<PoseKey, Value>> EntryList;
+
+  // Entries from the most to the least recently used, and their positions by key. The counters are written under the
+  // mutex and read without it. Padded rather than aligned, new does not align beyond alignof(std::max_align_t) before
+  // C++17.
+  struct Stripe
+  {
+    std::mutex mutex;
+    EntryList entries;
+    std::unordered_map<PoseKey, typename EntryList::iterator, PoseKeyHash> index;
+    std::atomic<std::uint64_t> hit_num;
+    std::atomic<std::uint64_t> miss_num;
+    char padding[CACHE_LINE_SIZE];
+  };
+
+  const std::size_t stripe_capacity_;
+  const double position_resolution_;
+  const double orientation_resolution_;
+
+  char front_padding_[CACHE_LINE_SIZE];
+  std::array<Stripe, STRIPE_NUM> stripes_;
+};
+
+}  // namespace xarm_kinematics_plugin
+
+#endif  // XARM_KINEMATICS_PLUGIN_IK_CACHE_H
@@ -0,0 +1,109 @@
+#ifndef XARM_KINEMATICS_PLUGIN_IK_STATISTICS_H
+#define XARM_KINEMATICS_PLUGIN_IK_STATISTICS_H
+
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "xarm_kinematics_plugin/thread_blocks.h"
+#include "xarm_kinematics_plugin/xarm_kinematics_core.h"
+
+namespace xarm_kinematics_plugin
+{
+// Latency histograms of the IK calls keyed by the result and the winning branch, and outcomes of the candidates of the
+// closed-form solution. Every thread counts into its own block of ThreadBlocks, the blocks are summed up by
+// getSnapshot().
+class IkStatistics
+{
+public:
+  enum Result
+  {
+    SUCCESS,
+    NO_SOLUTION,
+    TIMED_OUT,
+    OTHER_ERROR,  // E.g. of the solution callback
+    RESULT_NUM
+  };
+
+  // Sign of theta3 and whether the wrist is reached over the Z axis
+  enum Branch
+  {
+    ELBOW_POSITIVE,
+    ELBOW_NEGATIVE,
+    OVER_ELBOW_POSITIVE,
+    OVER_ELBOW_NEGATIVE,
+    NO_BRANCH,  // Without a solution
+    BRANCH_NUM
+  };
+
+  // Log-linear buckets of the latency in nanoseconds like an HDR histogram, SUB_BUCKET_NUM per power of two up to
+  // 2^32 ns, i.e. a relative error of 25 %. Longer calls count in the last bucket.
+  static constexpr int SUB_BUCKET_BITS = 2;
+  static constexpr int SUB_BUCKET_NUM = 1 << SUB_BUCKET_BITS;
+  static constexpr int BUCKET_NUM = (33 - SUB_BUCKET_BITS) * SUB_BUCKET_NUM;
+
+  static constexpr int SINGULARITY_NUM = 6;  // Of XarmKinematicsCore::Singularity
+
+  typedef std::array<std::uint64_t, BUCKET_NUM> Histogram;
+
+  struct Snapshot
+  {
+    std::array<std::array<Histogram, BRANCH_NUM>, RESULT_NUM> latency_histograms;
+    std::array<std::uint64_t, CANDIDATE_NUM> nan_candidate_nums;    // By the index of computeAllPossibleSolutions()
+    std::array<std::uint64_t, CANDIDATE_NUM> exact_candidate_nums;  // Valid and exact ones
+    std::array<std::uint64_t, SINGULARITY_NUM> singularity_nums;    // Targets solved by their class
+
+    std::uint64_t getCallNum(Result result, Branch branch) const;
+
+    // Upper bound of the bucket of the quantile in nanoseconds, 0 without calls
+    std::uint64_t getLatencyQuantile(Result result, Branch branch, double quantile) const;
+  };
+
+  IkStatistics() = default;
+
+  IkStatistics(const IkStatistics&) = delete;
+  IkStatistics& operator=(const IkStatistics&) = delete;
+
+  void recordCall(Result result, Branch branch, std::uint64_t latency_ns);
+
+  // Bit i of the masks is set if candidate i of computeAllPossibleSolutions() is NaN or a solution
+  void recordCandidates(std::uint32_t nan_mask, std::uint32_t exact_mask);
+
+  void recordSingularity(int singularity);
+
+  void getSnapshot(Snapshot& snapshot) const;
+
+  void reset();
+
+  // Key values of the calls and the candidates with counts, for the diagnostics
+  static void toDiagnosticStatus(const Snapshot& snapshot, diagnostic_msgs::DiagnosticStatus& status);
+
+  static int getBucket(std::uint64_t latency_ns);
+
+  // Largest latency in the bucket in nanoseconds
+  static std::uint64_t getBucketUpperBound(int bucket);
+
+  static const char* getResultName(Result result);
+
+  static const char* getBranchName(Branch branch);
+
+private:
+  // Only its thread counts into a block, the atomics let getSnapshot() and reset() read and clear it meanwhile
+  struct ThreadCounters
+  {
+    std::array<std::array<std::array<std::atomic<std::uint64_t>, BUCKET_NUM>, BRANCH_NUM>, RESULT_NUM>
+        latency_histograms;
+    std::array<std::atomic<std::uint64_t>, CANDIDATE_NUM> nan_candidate_nums;
+    std::array<std::atomic<std::uint64_t>, CANDIDATE_NUM> exact_candidate_nums;
+    std::array<std::atomic<std::uint64_t>, SINGULARITY_NUM> singularity_nums;
+  };
+
+  ThreadBlocks<ThreadCounters> thread_counters_;
+
+  static void clear(ThreadCounters& counters);
+};
+
+}  // namespace xarm_kinematics_plugin
+
+#endif  // XARM_KINEMATICS_PLUGIN_IK_STATISTICS_H
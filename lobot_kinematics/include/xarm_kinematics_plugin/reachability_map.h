@@ -0,0 +1,86 @@
+#ifndef XARM_KINEMATICS_PLUGIN_REACHABILITY_MAP_H
+#define XARM_KINEMATICS_PLUGIN_REACHABILITY_MAP_H
+
+#include <geometry_msgs/Pose.h>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xarm_kinematics_plugin
+{
+// Bitset over voxels of the tool position and bins of the approach pitch, set where some joint values within the limits
+// reach the voxel with the pitch. Built offline by xarm_reachability_map_generator, loaded with mmap.
+class ReachabilityMap
+{
+public:
+  // Layout of the file, followed by the bits with the pitch bin changing fastest, then z, y and x
+  struct Header
+  {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t pitch_bin_num;
+    std::array<std::int32_t, 3> cell_num;
+    std::array<double, 3> origin;  // Corner of the first voxel
+    double resolution;             // Edge of a voxel in meters
+  };
+
+  ReachabilityMap();
+
+  ~ReachabilityMap();
+
+  ReachabilityMap(const ReachabilityMap&) = delete;
+  ReachabilityMap& operator=(const ReachabilityMap&) = delete;
+
+  // Empty map of all unreachable cells, to be filled with setReachable() and written with save()
+  void create(const std::array<double, 3>& origin, const std::array<std::int32_t, 3>& cell_num, double resolution,
+              std::uint32_t pitch_bin_num);
+
+  bool load(const std::string& path);
+
+  bool save(const std::string& path) const;
+
+  void unload();
+
+  bool isLoaded() const
+  {
+    return bits_ != nullptr;
+  }
+
+  const Header& getHeader() const
+  {
+    return header_;
+  }
+
+  // O(1) test of the cell of the pose, false outside the map
+  bool isReachable(const geometry_msgs::Pose& pose) const;
+
+  bool isReachable(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin) const;
+
+  void setReachable(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin);
+
+  // Elevation of the X axis of the tool, i.e. the approach direction, in [-pi/2, pi/2]
+  static double getApproachPitch(const geometry_msgs::Quaternion& q);
+
+  std::int32_t getPitchBin(double pitch) const;
+
+  // Center of the cell in meters and of the pitch bin in radians
+  void getCellCenter(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin, std::array<double, 3>& position,
+                     double& pitch) const;
+
+private:
+  Header header_;
+
+  const std::uint8_t* bits_;  // Into the mapping or owned_bits_
+  std::vector<std::uint8_t> owned_bits_;
+  void* mapping_;
+  std::size_t mapping_size_;
+
+  std::size_t getBitIndex(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin) const;
+
+  std::size_t getByteNum() const;
+};
+
+}  // namespace xarm_kinematics_plugin
+
+#endif  // XARM_KINEMATICS_PLUGIN_REACHABILITY_MAP_H
@@ -0,0 +1,138 @@
+#ifndef XARM_KINEMATICS_PLUGIN_SIMD_MATH_H
+#define XARM_KINEMATICS_PLUGIN_SIMD_MATH_H
+
+#include <cmath>
+#include <cstdint>
+
+namespace xarm_kinematics_plugin
+{
+namespace simd
+{
+// GCC vector extensions as wide as the target supports, e.g. 4 lanes with -mavx2 and 2 lanes with SSE2 or NEON
+#ifdef __AVX__
+#define SIMD_LANES 4
+#else
+#define SIMD_LANES 2
+#endif
+
+typedef double DoubleVec __attribute__((vector_size(SIMD_LANES * sizeof(double))));
+typedef std::int64_t MaskVec __attribute__((vector_size(SIMD_LANES * sizeof(double))));
+
+inline DoubleVec broadcast(double value)
+{
+  return value - DoubleVec{};  // value - 0 keeps the sign of zero
+}
+
+inline DoubleVec select(MaskVec mask, DoubleVec a, DoubleVec b)
+{
+  return mask ? a : b;
+}
+
+inline MaskVec signBit(DoubleVec x)
+{
+  return (MaskVec)x < 0;  // Reinterprets the bits
+}
+
+inline DoubleVec abs(DoubleVec x)
+{
+  return select(signBit(x), -x, x);
+}
+
+// Round to nearest, valid for |x| < 2^51
+inline DoubleVec round(DoubleVec x)
+{
+  const auto magic = broadcast(6755399441055744.0);
+  return (x + magic) - magic;
+}
+
+inline DoubleVec sqrt(DoubleVec x)
+{
+  DoubleVec result;
+  for (auto i = 0; i < SIMD_LANES; ++i)
+  {
+    result[i] = std::sqrt(x[i]);
+  }
+  return result;
+}
+
+// Both sin and cos of x with the Cephes polynomials, reduced to [-pi/4, pi/4] by multiples of pi/2
+inline void sincos(DoubleVec x, DoubleVec& s, DoubleVec& c)
+{
+  const auto quadrant = round(x * M_2_PI);
+  auto r = x - quadrant * 1.57079625129699707031;
+  r -= quadrant * 7.54978941586159635335E-8;
+  r -= quadrant * 5.39030285815811905290E-15;
+  const auto z = r * r;
+
+  auto sin_poly = 1.58962301576546568060E-10 * z - 2.50507477628578072866E-8;
+  sin_poly = sin_poly * z + 2.75573136213857245213E-6;
+  sin_poly = sin_poly * z - 1.98412698295895385996E-4;
+  sin_poly = sin_poly * z + 8.33333333332211858878E-3;
+  sin_poly = sin_poly * z - 1.66666666666666307295E-1;
+  const auto sin_r = r + r * z * sin_poly;
+
+  auto cos_poly = -1.13585365213876817300E-11 * z + 2.08757008419747316778E-9;
+  cos_poly = cos_poly * z - 2.75573141792967388112E-7;
+  cos_poly = cos_poly * z + 2.48015872888517045348E-5;
+  cos_poly = cos_poly * z - 1.38888888888730564116E-3;
+  cos_poly = cos_poly * z + 4.16666666666665929218E-2;
+  const auto cos_r = 1.0 - 0.5 * z + z * z * cos_poly;
+
+  // quadrant mod 4
+  const auto m = quadrant - 4.0 * round(quadrant * 0.25 - 0.375);
+  const auto swap = (m == 1.0) | (m == 3.0);
+  s = select(swap, cos_r, sin_r);
+  c = select(swap, sin_r, cos_r);
+  s = select((m == 2.0) | (m == 3.0), -s, s);
+  c = select((m == 1.0) | (m == 2.0), -c, c);
+}
+
+// Cephes atan, the three argument ranges are evaluated together and selected per lane
+inline DoubleVec atan(DoubleVec x)
+{
+  constexpr double more_bits = 6.123233995736765886130E-17;
+
+  const auto negative = signBit(x);
+  auto a = abs(x);
+  const auto large = a > 2.41421356237309504880;  // tan(3 * pi / 8)
+  const auto medium = (a > 0.66) & ~large;
+  a = select(large, -1.0 / a, select(medium, (a - 1.0) / (a + 1.0), a));
+  const auto z = a * a;
+
+  auto p = -8.750608600031904122785E-1 * z - 1.615753718733365076637E1;
+  p = p * z - 7.500855792314704667340E1;
+  p = p * z - 1.228866684490136173410E2;
+  p = p * z - 6.485021904942025371773E1;
+
+  auto q = z + 2.485846490142306297962E1;
+  q = q * z + 1.650270098316988542046E2;
+  q = q * z + 4.328810604912902668951E2;
+  q = q * z + 4.853903996359136964868E2;
+  q = q * z + 1.945506571482613964425E2;
+
+  auto result = a * z * p / q + a;
+  result += select(large, broadcast(more_bits), select(medium, broadcast(0.5 * more_bits), broadcast(0.0)));
+  result += select(large, broadcast(M_PI_2), select(medium, broadcast(M_PI_4), broadcast(0.0)));
+  return select(negative, -result, result);
+}
+
+// atan2 with the same quadrant, NaN and signed zero conventions as std::atan2 for finite arguments
+inline DoubleVec atan2(DoubleVec y, DoubleVec x)
+{
+  const auto y_negative = signBit(y);
+  const auto x_negative = signBit(x);
+  const auto pi = select(y_negative, broadcast(-M_PI), broadcast(M_PI));
+
+  auto result = atan(y / x);
+  result = select(x_negative & (x != 0.0), result + pi, result);
+
+  // x == 0, NaN is kept in y
+  const auto on_axis = select(y != y, y, select(y_negative, broadcast(-M_PI_2), broadcast(M_PI_2)));
+  const auto at_origin = select(x_negative, pi, y);
+  return select(x == 0.0, select(y == 0.0, at_origin, on_axis), result);
+}
+
+}  // namespace simd
+}  // namespace xarm_kinematics_plugin
+
+#endif  // XARM_KINEMATICS_PLUGIN_SIMD_MATH_H
@@ -0,0 +1,104 @@
+#ifndef XARM_KINEMATICS_PLUGIN_THREAD_BLOCKS_H
+#define XARM_KINEMATICS_PLUGIN_THREAD_BLOCKS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace xarm_kinematics_plugin
+{
+// One Block of counters per thread that records into it, so recording threads share no cache line and do not lock
+// once their block exists. Readers go through the blocks by forEach() meanwhile, the members of Block are atomics for
+// that. Blocks are zero-initialized.
+template <typename Block>
+class ThreadBlocks
+{
+public:
+  ThreadBlocks() : id_(getNextId())
+  {
+  }
+
+  ThreadBlocks(const ThreadBlocks&) = delete;
+  ThreadBlocks& operator=(const ThreadBlocks&) = delete;
+
+  // Block of the calling thread, only its first call locks
+  Block& get()
+  {
+    // Blocks of the instances that the thread used last, e.g. of the plugins of several groups
+    thread_local std::array<std::pair<std::uint64_t, Block*>, CACHED_NUM> cached_blocks{};
+    thread_local std::size_t next_cached = 0;
+    for (const auto& cached_block : cached_blocks)
+    {
+      if (cached_block.first == id_)
+      {
+        return *cached_block.second;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto thread_id = std::this_thread::get_id();
+    Block* block = nullptr;
+    for (const auto& thread_block : blocks_)
+    {
+      if (thread_block.first == thread_id)
+      {
+        block = &thread_block.second->block;
+        break;
+      }
+    }
+    if (!block)
+    {
+      std::unique_ptr<PaddedBlock> padded_block(new PaddedBlock());
+      block = &padded_block->block;
+      blocks_.emplace_back(thread_id, std::move(padded_block));
+    }
+
+    cached_blocks[next_cached++ % CACHED_NUM] = std::make_pair(id_, block);
+    return *block;
+  }
+
+  // Calls fn with every block, while threads may record into them
+  template <typename Fn>
+  void forEach(Fn&& fn) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& thread_block : blocks_)
+    {
+      fn(thread_block.second->block);
+    }
+  }
+
+private:
+  static constexpr std::size_t CACHED_NUM = 4;
+  static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+  // Padded on both sides, new does not align beyond alignof(std::max_align_t) before C++17
+  struct PaddedBlock
+  {
+    char front_padding[CACHE_LINE_SIZE];
+    Block block;
+    char back_padding[CACHE_LINE_SIZE];
+  };
+
+  // Unique over the lifetime of the process, unlike the address of a destroyed instance
+  const std::uint64_t id_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::pair<std::thread::id, std::unique_ptr<PaddedBlock>>> blocks_;
+
+  static std::uint64_t getNextId()
+  {
+    static std::atomic<std::uint64_t> next_id(1);
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+}  // namespace xarm_kinematics_plugin
+
+#endif  // XARM_KINEMATICS_PLUGIN_THREAD_BLOCKS_H
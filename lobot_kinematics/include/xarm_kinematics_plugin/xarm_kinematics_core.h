@@ -0,0 +1,663 @@
+#ifndef XARM_KINEMATICS_PLUGIN_XARM_KINEMATICS_CORE_H
+#define XARM_KINEMATICS_PLUGIN_XARM_KINEMATICS_CORE_H
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "xarm_kinematics_plugin/xarm_geometry.h"
+
+#define JOINT_NUM 5
+#define CANDIDATE_NUM 16  // 4 theta3 x 2 theta2 x 2 theta1 of the closed-form solution
+
+namespace xarm_kinematics_plugin
+{
+// Lengths of the arm generated from xarm.urdf. A variant with another tool derives from it and hides tool_length.
+struct XarmGeometry
+{
+  static constexpr double a1 = geometry::a1;
+  static constexpr double a2 = geometry::a2;
+  static constexpr double a3 = geometry::a3;
+  static constexpr double base_height = geometry::base_height;
+  static constexpr double tool_length = geometry::tool_length;
+};
+
+// Closed-form kinematics of the tool point without ROS, shared by XarmKinematicsPlugin and lobot_ik::XArmIk. The
+// lengths of Geometry are compile-time constants, so every instantiation is a kernel of its own. The joint limits are
+// left to the caller.
+template <typename Scalar, typename Geometry = XarmGeometry>
+class XarmKinematicsCore
+{
+public:
+  typedef std::array<Scalar, JOINT_NUM> JointValues;
+  typedef std::array<JointValues, CANDIDATE_NUM> Candidates;
+
+  // Rows x, y, z, pitch and roll of the tool pose, columns the joints
+  typedef std::array<std::array<Scalar, JOINT_NUM>, JOINT_NUM> Jacobian;
+
+  // Singular configurations of the target, classified from its geometry before solving
+  enum class Singularity
+  {
+    NONE,
+    OUT_OF_REACH,        // The wrist is beyond the reach of link 2 and link 3, there is no solution
+    BOUNDARY,            // The wrist is at the edge of the reach, the elbow is stretched
+    WRIST,               // The tool axis is vertical, parallel to the axis of arm_joint1
+    SHOULDER,            // The wrist is close to the axis of arm_joint1 and barely determines theta1
+    SHOULDER_AND_WRIST,  // Both, theta1 is free and arm_joint5 makes up for it
+  };
+
+  // Errors of the wrist position and of the X and Y axes of the tool that isSolutionExact() bounds
+  typedef std::array<Scalar, 9> Residual;
+  typedef std::array<std::array<Scalar, JOINT_NUM>, 9> ResidualJacobian;
+
+  // Target of the closed-form solution, i.e. the rotation (n, o, a) and the position of the wrist
+  struct Target
+  {
+    Scalar nx, ny, nz;
+    Scalar ox, oy, oz;
+    Scalar ax, ay, az;
+    Scalar px, py, pz;
+    Scalar near_sq, far_sq;  // Squared distances from arm_joint2 to the wrist
+  };
+
+  static constexpr Scalar a1 = Geometry::a1;
+  static constexpr Scalar a2 = Geometry::a2;
+  static constexpr Scalar a3 = Geometry::a3;
+  static constexpr Scalar base_height = Geometry::base_height;
+  static constexpr Scalar tool_length = Geometry::tool_length;
+
+  // The longest and the shortest reach of link 2 and link 3
+  static constexpr Scalar max_reach_sq = (Geometry::a2 + Geometry::a3) * (Geometry::a2 + Geometry::a3);
+  static constexpr Scalar min_reach_sq = (Geometry::a2 - Geometry::a3) * (Geometry::a2 - Geometry::a3);
+
+  // Distance of the wrist from the axis of arm_joint1 in meters below which theta1 of computeAllPossibleSolutions()
+  // loses its precision
+  static constexpr Scalar shoulder_radius = 1e-3;
+
+  // Distance from a singularity below which it is exact to within the precision of Scalar, and above which the angles
+  // of the regular path are
+  static constexpr Scalar singular_tolerance = (sizeof(Scalar) < sizeof(double)) ? 3.5e-4 : 1.5e-8;
+
+  static void quaternionToRpy(Scalar qx, Scalar qy, Scalar qz, Scalar qw, Scalar& roll, Scalar& pitch, Scalar& yaw)
+  {
+    // Elements of the rotation matrix, sin(pitch) = -r20 and cos(pitch) = hypot(r21, r22)
+    const auto r20 = 2 * (qx * qz - qw * qy);
+    const auto r21 = 2 * (qy * qz + qw * qx);
+    const auto r22 = qw * qw - qx * qx - qy * qy + qz * qz;
+    const auto cp = std::sqrt(r21 * r21 + r22 * r22);
+
+    // Pitch, Y axis
+    pitch = std::atan2(-r20, cp);
+    if (cp < singular_tolerance)
+    {
+      // The X axis is vertical, roll and yaw turn about the same axis and only their sum or difference is defined. All
+      // of it goes to the roll, the projection onto the plane of the arm puts the yaw at the azimuth anyway.
+      roll = std::atan2(-r20 * 2 * (qx * qy - qw * qz), qw * qw - qx * qx + qy * qy - qz * qz);
+      yaw = 0;
+      return;
+    }
+
+    // Roll, X axis
+    roll = std::atan2(r21, r22);
+    // Yaw, Z axis
+    yaw = std::atan2(2 * (qx * qy + qw * qz), qw * qw + qx * qx - qy * qy - qz * qz);
+  }
+
+  // Quaternion of Rz(yaw) * Ry(pitch) * Rx(roll), the inverse of quaternionToRpy()
+  static void rpyToQuaternion(Scalar roll, Scalar pitch, Scalar yaw, Scalar& qx, Scalar& qy, Scalar& qz, Scalar& qw)
+  {
+    const auto hsr = std::sin(roll / 2), hcr = std::cos(roll / 2);
+    const auto hsp = std::sin(pitch / 2), hcp = std::cos(pitch / 2);
+    const auto hsy = std::sin(yaw / 2), hcy = std::cos(yaw / 2);
+    qx = hsr * hcp * hcy - hcr * hsp * hsy;
+    qy = hcr * hsp * hcy + hsr * hcp * hsy;
+    qz = hcr * hcp * hsy - hsr * hsp * hcy;
+    qw = hcr * hcp * hcy + hsr * hsp * hsy;
+  }
+
+  // Nearest orientation to Rz(yaw) * Ry(pitch) * Rx(roll) that the arm reaches at the azimuth of the tool point, i.e.
+  // Rz(azimuth) * Ry(projected_pitch) * Rx(projected_roll) whose X axis lies in the vertical plane of the arm. The
+  // projected pitch is beyond pi / 2 when the arm reaches over the Z axis. Returns the angle between both orientations.
+  static Scalar projectOrientation(Scalar azimuth, Scalar roll, Scalar pitch, Scalar yaw, Scalar& projected_roll,
+                                   Scalar& projected_pitch)
+  {
+    const auto sd = std::sin(yaw - azimuth), cd = std::cos(yaw - azimuth);
+    const auto sp = std::sin(pitch), cp = std::cos(pitch);
+
+    // Already in the plane, e.g. the pose of the FK, the yaw is the azimuth or the azimuth + pi when reaching over. A
+    // vertical X axis is in the plane as well, but the difference of yaw and azimuth goes to the roll then.
+    if (std::abs(sd) < 16 * std::numeric_limits<Scalar>::epsilon())
+    {
+      const auto pi = static_cast<Scalar>(M_PI);
+      projected_roll = (cd >= 0) ? roll : (roll > 0 ? roll - pi : roll + pi);
+      projected_pitch = (cd >= 0) ? pitch : (pitch > 0 ? pi - pitch : -pi - pitch);
+      return std::abs(std::asin(sd * cp));
+    }
+
+    const auto sr = std::sin(roll), cr = std::cos(roll);
+
+    // X axis u and Y axis e of the orientation relative to the plane of the arm, u is tilted onto the plane
+    const std::array<Scalar, 3> u{ { cd * cp, sd * cp, -sp } };
+    const std::array<Scalar, 3> e{ { cd * sp * sr - sd * cr, sd * sp * sr + cd * cr, cp * sr } };
+    projected_pitch = std::atan2(sp, cd * cp);
+    const auto spp = std::sin(projected_pitch), cpp = std::cos(projected_pitch);
+    const std::array<Scalar, 3> v{ { cpp, 0, -spp } };
+
+    // The smallest rotation from u to v applied to e, w = u x v and c = u . v >= 0
+    const std::array<Scalar, 3> w{ { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                                     u[0] * v[1] - u[1] * v[0] } };
+    const auto c = u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+    const std::array<Scalar, 3> we{ { w[1] * e[2] - w[2] * e[1], w[2] * e[0] - w[0] * e[2],
+                                      w[0] * e[1] - w[1] * e[0] } };
+    const std::array<Scalar, 3> wwe{ { w[1] * we[2] - w[2] * we[1], w[2] * we[0] - w[0] * we[2],
+                                       w[0] * we[1] - w[1] * we[0] } };
+    std::array<Scalar, 3> y_axis;
+    for (auto i = 0; i < 3; ++i)
+    {
+      y_axis[i] = e[i] + we[i] + wwe[i] / (1 + c);
+    }
+
+    // Ry(projected_pitch)^T * y_axis = (0, cos(projected_roll), sin(projected_roll))
+    projected_roll = std::atan2(spp * y_axis[0] + cpp * y_axis[2], y_axis[1]);
+
+    // The distance of u from the plane
+    return std::asin(std::min<Scalar>(1, std::abs(u[1])));
+  }
+
+  // The tool point at (x, y, z) with the orientation Rz(azimuth) * Ry(pitch) * Rx(roll), the yaw is replaced by the
+  // azimuth of the position since the arm cannot turn the tool about the Z axis otherwise. Out of reach the wrist is
+  // kept, computeAllPossibleSolutions() then gives no finite candidate.
+  static void computeTarget(Scalar x, Scalar y, Scalar z, Scalar roll, Scalar pitch, Target& target)
+  {
+    const auto yaw = std::atan2(y, x);
+    const auto sr = std::sin(roll), cr = std::cos(roll);
+    const auto sp = std::sin(pitch), cp = std::cos(pitch);
+    const auto sy = std::sin(yaw), cy = std::cos(yaw);
+
+    // Columns of the rotation, the tool frame relative to the last frame on the manipulator
+    target.nx = cy * sp * cr + sy * sr, target.ny = sy * sp * cr - cy * sr, target.nz = cp * cr;
+    target.ox = sy * cr - cy * sp * sr, target.oy = -cy * cr - sy * sp * sr, target.oz = -cp * sr;
+    target.ax = cy * cp, target.ay = sy * cp, target.az = -sp;
+    target.px = x - tool_length * target.ax;
+    target.py = y - tool_length * target.ay;
+    target.pz = z - tool_length * target.az - base_height;
+
+    // Squared distances from arm_joint2 to the wrist when the arm points towards / away from the wrist
+    const auto rho = std::sqrt(target.px * target.px + target.py * target.py);
+    target.near_sq = (rho - a1) * (rho - a1) + target.pz * target.pz;
+    target.far_sq = (rho + a1) * (rho + a1) + target.pz * target.pz;
+  }
+
+  static Singularity classifyTarget(const Target& target)
+  {
+    // Beyond rounding, see clampToBoundary(). NaN is out of reach as well.
+    const auto near_difference = clampToBoundary(max_reach_sq - target.near_sq, max_reach_sq);
+    if (!(near_difference >= 0 && target.far_sq >= min_reach_sq))
+    {
+      return Singularity::OUT_OF_REACH;
+    }
+
+    // Distances of the wrist and of the tool axis from the axis of arm_joint1
+    const auto rho = std::sqrt(target.px * target.px + target.py * target.py);
+    const auto tool_radius = std::sqrt(target.ax * target.ax + target.ay * target.ay);
+    if (rho < shoulder_radius)
+    {
+      return (rho < singular_tolerance && tool_radius < singular_tolerance) ? Singularity::SHOULDER_AND_WRIST :
+                                                                              Singularity::SHOULDER;
+    }
+    if (tool_radius < singular_tolerance)
+    {
+      return Singularity::WRIST;
+    }
+    if (near_difference < singular_tolerance * max_reach_sq)
+    {
+      return Singularity::BOUNDARY;
+    }
+    return Singularity::NONE;
+  }
+
+  static const char* getSingularityName(Singularity singularity)
+  {
+    switch (singularity)
+    {
+      case Singularity::NONE:
+        return "regular";
+      case Singularity::OUT_OF_REACH:
+        return "out of reach";
+      case Singularity::BOUNDARY:
+        return "at the boundary of the workspace";
+      case Singularity::WRIST:
+        return "at the wrist singularity";
+      case Singularity::SHOULDER:
+        return "at the shoulder singularity";
+      case Singularity::SHOULDER_AND_WRIST:
+        return "at the shoulder and wrist singularity";
+    }
+    return "unknown";
+  }
+
+  // Candidates of the target of classifyTarget(), returns their number. Out of reach there is none. Close to the axis
+  // of arm_joint1, theta1 follows from the direction of the tool axis or of the wrist, whichever is better conditioned,
+  // or is free_theta1 if both are vertical. Elsewhere they are computeAllPossibleSolutions().
+  static int computeSolutions(const Target& target, Singularity singularity, Scalar free_theta1, Candidates& solutions)
+  {
+    switch (singularity)
+    {
+      case Singularity::OUT_OF_REACH:
+        return 0;
+      case Singularity::SHOULDER:
+      {
+        const auto rho = std::sqrt(target.px * target.px + target.py * target.py);
+        const auto tool_radius = std::sqrt(target.ax * target.ax + target.ay * target.ay);
+        const auto theta1 = (tool_radius * (a2 + a3) >= rho) ? std::atan2(target.ay, target.ax) :
+                                                                std::atan2(target.py, target.px);
+        return computePlanarSolutions(target, theta1, solutions);
+      }
+      case Singularity::SHOULDER_AND_WRIST:
+        return computePlanarSolutions(target, free_theta1, solutions);
+      default:
+        computeAllPossibleSolutions(target, solutions);
+        return CANDIDATE_NUM;
+    }
+  }
+
+  // Candidates with theta1 and with theta1 + pi, i.e. reaching over the Z axis, each with both elbows. The rest is the
+  // planar arm of link 2 and link 3 to the wrist and the tool axes in the plane. Returns their number.
+  static int computePlanarSolutions(const Target& target, Scalar theta1, Candidates& solutions)
+  {
+    const auto pi = static_cast<Scalar>(M_PI);
+    auto solution_num = 0;
+    for (const auto t1 : { theta1, (theta1 > 0) ? theta1 - pi : theta1 + pi })
+    {
+      const auto s1 = std::sin(t1);
+      const auto c1 = std::cos(t1);
+
+      // The wrist relative to arm_joint2 in the plane of the arm, tan(theta3 / 2)^2 from the law of cosines
+      const auto r = target.px * c1 + target.py * s1 - a1;
+      const auto d_sq = r * r + target.pz * target.pz;
+      const auto half_theta3 =
+          std::atan(std::sqrt(clampToBoundary(max_reach_sq - d_sq, max_reach_sq) / (d_sq - min_reach_sq)));
+
+      // theta2 + theta3 + theta4 and theta5 from the tool axes, see isSolutionExact()
+      const auto s = target.ax * c1 + target.ay * s1;
+      const auto c = target.az;
+      const auto phi = std::atan2(s, c);
+      const auto t5 =
+          std::atan2(c * (target.ox * c1 + target.oy * s1) - s * target.oz, target.ox * s1 - target.oy * c1);
+
+      for (const auto t3 : { 2 * half_theta3, -2 * half_theta3 })
+      {
+        const auto t2 = std::remainder(std::atan2(r, target.pz) - std::atan2(a3 * std::sin(t3), a2 + a3 * std::cos(t3)),
+                                       2 * pi);
+        solutions[solution_num++] = { { t1, t2, t3, std::remainder(phi - t2 - t3, 2 * pi), t5 } };
+      }
+    }
+    return solution_num;
+  }
+
+  // All candidates of the closed-form solution, including the invalid ones and the extraneous roots
+  static void computeAllPossibleSolutions(const Target& target, Candidates& all_solutions)
+  {
+    const auto nx = target.nx, ny = target.ny, nz = target.nz;
+    const auto ox = target.ox, oy = target.oy, oz = target.oz;
+    const auto ax = target.ax, ay = target.ay, az = target.az;
+    const auto px = target.px, py = target.py, pz = target.pz;
+    const auto near_sq = target.near_sq, far_sq = target.far_sq;
+    const auto p_sq = px * px + py * py + pz * pz;
+
+    // All possible solutions of theta 3
+    const auto denominator3 = (near_sq - min_reach_sq) * (far_sq - min_reach_sq);
+    const auto theta3_near = 2 * std::atan(std::sqrt(clampToBoundary(max_reach_sq - near_sq, max_reach_sq) *
+                                                     (far_sq - min_reach_sq) / denominator3));
+    const auto theta3_far = -2 * std::atan(std::sqrt(clampToBoundary(max_reach_sq - far_sq, max_reach_sq) *
+                                                      (near_sq - min_reach_sq) / denominator3));
+    const Scalar theta3_list[] = { theta3_near, theta3_far, -theta3_near, -theta3_far };
+
+    auto candidate_it = all_solutions.begin();
+    for (const auto t3 : theta3_list)
+    {
+      const auto s3 = std::sin(t3);
+      const auto c3 = std::cos(t3);
+
+      // All possible solutions of theta 2, (c3^2 + s3^2) terms are reduced to 1
+      const auto reach_sq = a2 * a2 + a3 * a3 + 2 * a2 * a3 * c3;
+      const auto k = p_sq - a1 * a1 - reach_sq;
+      const auto root2 = std::sqrt(clampToBoundary(4 * a1 * a1 * reach_sq - k * k, 4 * a1 * a1 * reach_sq));
+      const auto denominator2 = k + 2 * a1 * (a2 + a3 * c3);
+      const Scalar theta2_list[] = { 2 * std::atan((root2 - 2 * a1 * a3 * s3) / denominator2),
+                                     -2 * std::atan((root2 + 2 * a1 * a3 * s3) / denominator2) };
+
+      for (const auto t2 : theta2_list)
+      {
+        const auto s2 = std::sin(t2);
+        const auto c2 = std::cos(t2);
+        const auto s23 = c2 * s3 + c3 * s2;
+        const auto c23 = c2 * c3 - s2 * s3;
+
+        // Both solutions of theta 1 to reach * cos(t1) = px, sin(-t1) = -sin(t1) and cos(-t1) = cos(t1). atan2 keeps
+        // the precision of small angles, NaN when the branch cannot reach px
+        const auto reach = a1 + a2 * c2 + a3 * c23;
+        const auto t1 = (std::abs(px) > std::abs(reach) + FLT_EPSILON) ?
+                            static_cast<Scalar>(NAN) :
+                            std::atan2(std::abs(py), (reach < 0) ? -px : px);
+        const auto s1_positive = std::sin(t1);
+        const auto c1 = std::cos(t1);
+
+        for (const Scalar sign : { 1, -1 })
+        {
+          const auto s1 = sign * s1_positive;
+
+          // All (c^2 + s^2)^n denominators of the symbolic solution are reduced to 1
+          const auto a_radial = ax * c1 + ay * s1;
+          const auto y4 = az * s23 - a_radial * c23;
+          const auto x4 = -a_radial * s23 - az * c23;
+          const auto t4 = std::atan2(y4, x4);
+
+          // sin/cos of theta 2 + theta 3 + theta 4 scaled by hypot(x4, y4), which cancels out in atan2
+          const auto s234 = s23 * x4 + c23 * y4;
+          const auto c234 = c23 * x4 - s23 * y4;
+          const auto t5 = std::atan2(oz * s234 - (ox * c1 + oy * s1) * c234, (nx * c1 + ny * s1) * c234 - nz * s234);
+
+          *candidate_it++ = { { sign * t1, wrapOffsetAngle(t2), t3, wrapOffsetAngle(t4), t5 } };
+        }
+      }
+    }
+  }
+
+  // Whether the candidate reaches the target within the tolerance, in meters for the wrist and for the tool axes
+  static bool isSolutionExact(const JointValues& solution, const Target& target, Scalar tolerance)
+  {
+    const auto s1 = std::sin(solution[0]);
+    const auto c1 = std::cos(solution[0]);
+    const auto phi = solution[1] + solution[2] + solution[3];
+    const auto s = std::sin(phi);
+    const auto c = std::cos(phi);
+    const auto s5 = std::sin(solution[4]);
+    const auto c5 = std::cos(solution[4]);
+
+    // Wrist position
+    const auto r = a1 + a2 * std::sin(solution[1]) + a3 * std::sin(solution[1] + solution[2]);
+    const auto z = a2 * std::cos(solution[1]) + a3 * std::cos(solution[1] + solution[2]);
+    if (std::abs(r * c1 - target.px) > tolerance || std::abs(r * s1 - target.py) > tolerance ||
+        std::abs(z - target.pz) > tolerance)
+    {
+      return false;
+    }
+
+    // X axis (a) and Y axis (-o) of the tool, the Z axis follows from both
+    const auto yx = -c1 * c * s5 - s1 * c5;
+    const auto yy = -s1 * c * s5 + c1 * c5;
+    const auto yz = s * s5;
+    const Scalar errors[] = { c1 * s - target.ax, s1 * s - target.ay, c - target.az,
+                              yx + target.ox,     yy + target.oy,     yz + target.oz };
+    for (const auto error : errors)
+    {
+      if (std::abs(error) > tolerance)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Residual of the candidate against the target and, unless null, its analytic Jacobian by the joints. Returns the
+  // squared norm of the residual.
+  static Scalar computeResidual(const JointValues& solution, const Target& target, Residual& residual,
+                                ResidualJacobian* jacobian)
+  {
+    const auto s1 = std::sin(solution[0]);
+    const auto c1 = std::cos(solution[0]);
+    const auto s2 = std::sin(solution[1]);
+    const auto c2 = std::cos(solution[1]);
+    const auto s23 = std::sin(solution[1] + solution[2]);
+    const auto c23 = std::cos(solution[1] + solution[2]);
+    const auto phi = solution[1] + solution[2] + solution[3];
+    const auto s = std::sin(phi);
+    const auto c = std::cos(phi);
+    const auto s5 = std::sin(solution[4]);
+    const auto c5 = std::cos(solution[4]);
+
+    // Wrist position, X axis (a) and Y axis (-o) of the tool as in isSolutionExact()
+    const auto r = a1 + a2 * s2 + a3 * s23;
+    residual = { { r * c1 - target.px, r * s1 - target.py, a2 * c2 + a3 * c23 - target.pz, c1 * s - target.ax,
+                   s1 * s - target.ay, c - target.az, -c1 * c * s5 - s1 * c5 + target.ox,
+                   -s1 * c * s5 + c1 * c5 + target.oy, s * s5 + target.oz } };
+
+    Scalar norm_sq = 0;
+    for (const auto error : residual)
+    {
+      norm_sq += error * error;
+    }
+    if (!jacobian)
+    {
+      return norm_sq;
+    }
+
+    // arm_joint2 ~ arm_joint4 all turn the axes by phi, only arm_joint2 and arm_joint3 move the wrist
+    const auto dr2 = a2 * c2 + a3 * c23;
+    const auto dr3 = a3 * c23;
+    const auto dz2 = -a2 * s2 - a3 * s23;
+    const auto dz3 = -a3 * s23;
+    *jacobian = { { { { -r * s1, c1 * dr2, c1 * dr3, 0, 0 } },
+                    { { r * c1, s1 * dr2, s1 * dr3, 0, 0 } },
+                    { { 0, dz2, dz3, 0, 0 } },
+                    { { -s1 * s, c1 * c, c1 * c, c1 * c, 0 } },
+                    { { c1 * s, s1 * c, s1 * c, s1 * c, 0 } },
+                    { { 0, -s, -s, -s, 0 } },
+                    { { s1 * c * s5 - c1 * c5, c1 * s * s5, c1 * s * s5, c1 * s * s5, -c1 * c * c5 + s1 * s5 } },
+                    { { -c1 * c * s5 - s1 * c5, s1 * s * s5, s1 * s * s5, s1 * s * s5, -s1 * c * c5 - c1 * s5 } },
+                    { { 0, c * s5, c * s5, c * s5, s * c5 } } } };
+    return norm_sq;
+  }
+
+  // One damped least-squares iteration (J^T J + damping^2 I) step = -J^T residual towards the target. As in
+  // Levenberg-Marquardt, a step that lowers the residual is taken and the damping decreases, otherwise the solution is
+  // kept and the damping increases. Returns the largest error of the solution afterwards.
+  static Scalar refineSolution(JointValues& solution, const Target& target, Scalar& damping)
+  {
+    Residual residual;
+    ResidualJacobian jacobian;
+    const auto norm_sq = computeResidual(solution, target, residual, &jacobian);
+
+    Jacobian normal;
+    JointValues step;
+    for (auto i = 0; i < JOINT_NUM; ++i)
+    {
+      step[i] = 0;
+      for (auto j = 0; j < JOINT_NUM; ++j)
+      {
+        normal[i][j] = (i == j) ? damping * damping : 0;
+      }
+      for (std::size_t k = 0; k < residual.size(); ++k)
+      {
+        step[i] -= jacobian[k][i] * residual[k];
+        for (auto j = 0; j < JOINT_NUM; ++j)
+        {
+          normal[i][j] += jacobian[k][i] * jacobian[k][j];
+        }
+      }
+    }
+
+    // The damping keeps the normal matrix positive definite
+    JointValues trial = solution;
+    if (solveJacobian(normal, step, std::numeric_limits<Scalar>::min()))
+    {
+      for (auto i = 0; i < JOINT_NUM; ++i)
+      {
+        trial[i] += step[i];
+      }
+    }
+
+    Residual trial_residual;
+    if (computeResidual(trial, target, trial_residual, nullptr) < norm_sq)
+    {
+      solution = trial;
+      residual = trial_residual;
+      damping /= 10;
+    }
+    else
+    {
+      damping *= 10;
+    }
+
+    Scalar max_error = 0;
+    for (const auto error : residual)
+    {
+      max_error = std::max(max_error, std::abs(error));
+    }
+    return max_error;
+  }
+
+  // Position and quaternion (x, y, z, w) of the tool point, tool_length beyond arm_joint4 along the X axis
+  static void computeToolPose(const Scalar* joint_angles, std::array<Scalar, 3>& position,
+                              std::array<Scalar, 4>& orientation)
+  {
+    const auto phi = joint_angles[1] + joint_angles[2] + joint_angles[3];
+    const auto r = a1 + a2 * std::sin(joint_angles[1]) + a3 * std::sin(joint_angles[1] + joint_angles[2]) +
+                   tool_length * std::sin(phi);
+    const auto z = base_height + a2 * std::cos(joint_angles[1]) + a3 * std::cos(joint_angles[1] + joint_angles[2]) +
+                   tool_length * std::cos(phi);
+    position = { { r * std::cos(joint_angles[0]), r * std::sin(joint_angles[0]), z } };
+
+    // Quaternion of Rz(theta1) * Ry(phi) * Rz(theta5) * Ry(-pi / 2), the approach direction is the X axis of the tool
+    const auto hs1 = std::sin(joint_angles[0] / 2);
+    const auto hc1 = std::cos(joint_angles[0] / 2);
+    const auto hs = std::sin(phi / 2);
+    const auto hc = std::cos(phi / 2);
+    const auto hs5 = std::sin(joint_angles[4] / 2);
+    const auto hc5 = std::cos(joint_angles[4] / 2);
+
+    const auto w0 = hc1 * hc;
+    const auto x0 = -hs1 * hs;
+    const auto y0 = hc1 * hs;
+    const auto z0 = hs1 * hc;
+
+    const auto w1 = w0 * hc5 - z0 * hs5;
+    const auto x1 = x0 * hc5 + y0 * hs5;
+    const auto y1 = y0 * hc5 - x0 * hs5;
+    const auto z1 = w0 * hs5 + z0 * hc5;
+
+    const auto sqrt1_2 = static_cast<Scalar>(M_SQRT1_2);
+    orientation = { { sqrt1_2 * (x1 + z1), sqrt1_2 * (y1 - w1), sqrt1_2 * (z1 - x1), sqrt1_2 * (w1 + y1) } };
+  }
+
+  // Position of computeToolPose() and its analytic Jacobian, the orientation is Rz(theta1) * Ry(pitch) * Rx(roll)
+  static void computeToolPositionAndJacobian(const Scalar* joint_angles, std::array<Scalar, 3>& position,
+                                             Jacobian& jacobian)
+  {
+    const auto s1 = std::sin(joint_angles[0]);
+    const auto c1 = std::cos(joint_angles[0]);
+    const auto s2 = std::sin(joint_angles[1]);
+    const auto c2 = std::cos(joint_angles[1]);
+    const auto s23 = std::sin(joint_angles[1] + joint_angles[2]);
+    const auto c23 = std::cos(joint_angles[1] + joint_angles[2]);
+    const auto s234 = std::sin(joint_angles[1] + joint_angles[2] + joint_angles[3]);
+    const auto c234 = std::cos(joint_angles[1] + joint_angles[2] + joint_angles[3]);
+
+    // Distance from the Z axis and height
+    const auto r = a1 + a2 * s2 + a3 * s23 + tool_length * s234;
+    position = { { r * c1, r * s1, base_height + a2 * c2 + a3 * c23 + tool_length * c234 } };
+
+    // Partial derivatives of the distance and of the height by arm_joint2 ~ arm_joint4
+    const auto dr4 = tool_length * c234;
+    const auto dr3 = a3 * c23 + dr4;
+    const auto dr2 = a2 * c2 + dr3;
+    const auto dz4 = -tool_length * s234;
+    const auto dz3 = -a3 * s23 + dz4;
+    const auto dz2 = -a2 * s2 + dz3;
+
+    // The tool orientation is Rz(theta1) * Ry(theta2 + theta3 + theta4 - pi / 2) * Rx(theta5)
+    jacobian = { { { { -r * s1, c1 * dr2, c1 * dr3, c1 * dr4, 0 } },
+                   { { r * c1, s1 * dr2, s1 * dr3, s1 * dr4, 0 } },
+                   { { 0, dz2, dz3, dz4, 0 } },
+                   { { 0, 1, 1, 1, 0 } },
+                   { { 0, 0, 0, 0, 1 } } } };
+  }
+
+  // Solves jacobian * step = error in place by Gaussian elimination with partial pivoting, error becomes the step.
+  // Returns false if a pivot is smaller than min_pivot, i.e. near a singularity.
+  static bool solveJacobian(Jacobian& jacobian, JointValues& error, Scalar min_pivot)
+  {
+    for (auto col = 0; col < JOINT_NUM; ++col)
+    {
+      auto pivot = col;
+      for (auto row = col + 1; row < JOINT_NUM; ++row)
+      {
+        if (std::abs(jacobian[row][col]) > std::abs(jacobian[pivot][col]))
+        {
+          pivot = row;
+        }
+      }
+      if (std::abs(jacobian[pivot][col]) < min_pivot)
+      {
+        return false;
+      }
+      std::swap(jacobian[col], jacobian[pivot]);
+      std::swap(error[col], error[pivot]);
+
+      for (auto row = col + 1; row < JOINT_NUM; ++row)
+      {
+        const auto factor = jacobian[row][col] / jacobian[col][col];
+        for (auto k = col; k < JOINT_NUM; ++k)
+        {
+          jacobian[row][k] -= factor * jacobian[col][k];
+        }
+        error[row] -= factor * error[col];
+      }
+    }
+    for (auto col = JOINT_NUM - 1; col >= 0; --col)
+    {
+      for (auto k = col + 1; k < JOINT_NUM; ++k)
+      {
+        error[col] -= jacobian[col][k] * error[k];
+      }
+      error[col] /= jacobian[col][col];
+    }
+    return true;
+  }
+
+private:
+  static constexpr Scalar half_pi = M_PI / 2;
+
+  // Joint value of theta2 or theta4 in (-pi, pi], the angle of atan2 is offset by pi / 2
+  static Scalar wrapOffsetAngle(Scalar angle)
+  {
+    return (angle > half_pi) ? angle - 3 * half_pi : angle + half_pi;
+  }
+
+  // Rounding pushes the difference slightly below zero at the boundary of the workspace, e.g. with the arm stretched,
+  // where the root of the closed-form solution is zero. Clearly negative ones are kept, the target is out of reach.
+  static Scalar clampToBoundary(Scalar difference, Scalar scale)
+  {
+    return (difference < 0 && difference > -64 * std::numeric_limits<Scalar>::epsilon() * scale) ? 0 : difference;
+  }
+};
+
+// Definitions of the constants for C++11, in case they are bound to references
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::a1;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::a2;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::a3;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::base_height;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::tool_length;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::max_reach_sq;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::min_reach_sq;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::half_pi;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::shoulder_radius;
+template <typename Scalar, typename Geometry>
+constexpr Scalar XarmKinematicsCore<Scalar, Geometry>::singular_tolerance;
+
+}  // namespace xarm_kinematics_plugin
+
+#endif  // XARM_KINEMATICS_PLUGIN_XARM_KINEMATICS_CORE_H
@@ -3,15 +3,32 @@
 
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <ros/ros.h>
-#include <tf/tf.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "xarm_kinematics_plugin/ik_cache.h"
+#include "xarm_kinematics_plugin/ik_statistics.h"
+#include "xarm_kinematics_plugin/reachability_map.h"
+#include "xarm_kinematics_plugin/thread_blocks.h"
+#include "xarm_kinematics_plugin/xarm_kinematics_core.h"
 
 namespace xarm_kinematics_plugin
 {
-#define JOINT_NUM 5
+#define LINK_NUM 7  // base_link, arm_link1 ~ arm_link5 and the tip link
+#define RESIDUAL_BIN_NUM 5  // Decades of the residual from the solution tolerance of 1e-6 up
 
+// After initialize(), the queries may run concurrently on any number of threads, e.g. of parallel planners. They work
+// on buffers on the stack of the calling thread, only read the configuration and count into blocks of their own thread,
+// so they neither lock nor write shared cache lines. The exception is the IK cache if ik_cache_size is set, whose
+// lookups lock one of its stripes. initialize() must not run concurrently with queries.
 class XarmKinematicsPlugin : public kinematics::KinematicsBase
 {
 public:
+  // Kernels of the xArm generated from xarm.urdf
+  typedef XarmKinematicsCore<double, XarmGeometry> Kinematics;
+
   XarmKinematicsPlugin();
 
   ~XarmKinematicsPlugin();
@@ -29,11 +46,33 @@ public:
   bool getPositionFK(const std::vector<std::string>& link_names, const std::vector<double>& joint_angles,
                      std::vector<geometry_msgs::Pose>& poses) const override;
 
+  // Closed-form FK of all links in the chain, in the order of getLinkNames() followed by the tip link. Does not
+  // allocate, joint_angles must point to JOINT_NUM values.
+  void computeFk(const double* joint_angles, std::array<geometry_msgs::Pose, LINK_NUM>& link_poses) const;
+
+  // Pose of the tool point in the convention of ik_pose, i.e. tool_length beyond arm_joint4 along the X axis
+  void computeToolPose(const double* joint_angles, geometry_msgs::Pose& pose) const;
+
+  // Rows x, y, z, pitch and roll of the tool pose, columns the joints
+  typedef Kinematics::Jacobian Jacobian;
+
+  // Analytic Jacobian of the tool pose of computeToolPose(), whose orientation is Rz(theta1) * Ry(pitch) * Rx(roll)
+  void computeJacobian(const double* joint_angles, Jacobian& jacobian) const;
+
+  // The IK of the five joints only reaches orientations with the approach direction in the vertical plane through the
+  // Z axis and the position. Other orientations fail with NO_IK_SOLUTION when they are more than 1e-6 rad from that
+  // plane, unless options.return_approximate_solution asks for the nearest reachable one, see projectPose(). This
+  // holds for all getPositionIK() and searchPositionIK() overloads and for solveTrajectory().
   bool getPositionIK(
       const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state, std::vector<double>& solution,
       moveit_msgs::MoveItErrorCodes& error_code,
       const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const override;
 
+  // All distinct solutions of the pose, sorted by the distance to the seed state
+  bool getPositionIK(const std::vector<geometry_msgs::Pose>& ik_poses, const std::vector<double>& ik_seed_state,
+                     std::vector<std::vector<double>>& solutions, kinematics::KinematicsResult& result,
+                     const kinematics::KinematicsQueryOptions& options) const override;
+
   bool initialize(const moveit::core::RobotModel& robot_model, const std::string& group_name,
                   const std::string& base_frame, const std::vector<std::string>& tip_frames,
                   double search_discretization) override;
@@ -60,23 +99,170 @@ public:
       const IKCallbackFn& solution_callback, moveit_msgs::MoveItErrorCodes& error_code,
       const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const override;
 
+  // Result of one pose in solveBatch()
+  struct BatchSolution
+  {
+    bool found;
+    std::array<double, JOINT_NUM> joint_values;
+  };
+
+  // One exact solution within the joint limits for every pose, the first such candidate of the closed-form solution
+  // evaluated several poses at a time with the SIMD kernel in simd_math.h. Poses without one, e.g. near singularities,
+  // take the exact solution closest to the zero seed state, as searchPositionIK() ranks them. solutions must point to
+  // pose_num elements.
+  void solveBatch(const geometry_msgs::Pose* poses, std::size_t pose_num, BatchSolution* solutions) const;
+
+  // Projects the orientation of the pose onto the orientations that the arm reaches at its position, i.e. with the
+  // approach direction in the vertical plane through the Z axis. Returns the angle between both orientations in
+  // radians.
+  double projectPose(const geometry_msgs::Pose& pose, geometry_msgs::Pose& projected_pose) const;
+
+  // Singular configuration of the pose, e.g. why the IK found no solution
+  Kinematics::Singularity classifyPose(const geometry_msgs::Pose& pose) const;
+
+  // Hits and misses of the IK cache since the last initialize(), returns false if the cache is disabled
+  bool getIkCacheStatistics(std::uint64_t& hit_num, std::uint64_t& miss_num) const;
+
+  // Candidates of the closed-form solution refined since the last initialize()
+  struct RefinementStatistics
+  {
+    std::uint64_t refined_num;    // Candidates beyond the solution tolerance but within ik_refinement_max_residual
+    std::uint64_t converged_num;  // Of them refined to within the solution tolerance
+    std::uint64_t timed_out_num;  // Of them stopped by the timeout
+    std::uint64_t iteration_num;  // Damped least-squares iterations of all of them
+    double max_residual;          // Largest error of a converged one in meters, of the wrist or of the tool axes
+
+    // Refined candidates by the largest error of the closed-form solution, [1e-6, 1e-5), [1e-5, 1e-4) ... [1e-2, inf)
+    std::array<std::uint64_t, RESIDUAL_BIN_NUM> residual_histogram;
+  };
+
+  // Returns false if the refinement is disabled
+  bool getRefinementStatistics(RefinementStatistics& statistics) const;
+
+  // Latency and branch statistics of searchPositionIK() since the last initialize(), returns false unless built with
+  // XARM_KINEMATICS_STATISTICS
+  bool getIkStatistics(IkStatistics::Snapshot& snapshot) const;
+
+  // Joint path of solveTrajectory()
+  struct TrajectorySolution
+  {
+    std::vector<std::vector<double>> joint_values;  // One per pose, empty where the pose has no solution
+    std::vector<std::size_t> discontinuities;       // Poses without a solution or reached with a jump of a joint
+  };
+
+  // IK of an ordered list of poses, e.g. the waypoints of a Cartesian path, on one branch. Of the exact solutions of
+  // all poses it picks the sequence with the least weighted joint motion from the seed state, so the elbow and the
+  // wrist do not flip between neighbouring poses. A jump beyond trajectory_max_joint_step from the previous pose, or
+  // from the seed state for the first one, marks a pose where no continuous branch exists. Returns false if there are
+  // discontinuities.
+  bool solveTrajectory(const std::vector<geometry_msgs::Pose>& poses, const std::vector<double>& ik_seed_state,
+                       double timeout, TrajectorySolution& solution,
+                       const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
+
 private:
+  // Fixed-size storage, the IK does not allocate
+  typedef Kinematics::JointValues JointValues;
+  typedef Kinematics::Candidates Candidates;
+  typedef Kinematics::Target IkTarget;
+
+  // The distinct valid and exact candidates of a pose, which do not depend on the seed state
+  struct ExactSolutions
+  {
+    int solution_num;
+    Candidates solutions;
+  };
+
   std::vector<std::string> joint_names_;
   std::vector<std::string> link_names_;
   std::vector<double> lower_limits_;
   std::vector<double> upper_limits_;
+  std::vector<double> joint_weights_;  // Weights of the joints in the distance to the seed state
+
+  std::unique_ptr<IkCache<ExactSolutions>> ik_cache_;  // Null if ik_cache_size is 0
+
+  ReachabilityMap reachability_map_;  // Not loaded if reachability_map is empty
+
+  // Newton steps from the seed state before the closed-form solution, for targets close to the seed
+  bool differential_ik_;
+  double differential_ik_max_step_;  // Largest distance of the target from the seed state in meters and radians
+
+  // Damped least-squares iterations after the closed-form solution for the candidates that rounding leaves beyond the
+  // solution tolerance near singularities, until the timeout
+  bool ik_refinement_;
+  double ik_refinement_max_residual_;  // Largest error of a candidate to refine, farther ones are other branches
+  int ik_refinement_max_iterations_;
+
+  double trajectory_max_joint_step_;  // Largest change of a joint between two poses of solveTrajectory() in radians
+
+  // Null unless built with XARM_KINEMATICS_STATISTICS, then published to /diagnostics every ik_statistics_period
+  std::unique_ptr<IkStatistics> ik_statistics_;
+  ros::Publisher diagnostics_publisher_;
+  ros::WallTimer diagnostics_timer_;
+
+  // Counters of RefinementStatistics, one block per thread that runs the IK
+  struct RefinementCounters
+  {
+    std::atomic<std::uint64_t> refined_num;
+    std::atomic<std::uint64_t> converged_num;
+    std::atomic<std::uint64_t> timed_out_num;
+    std::atomic<std::uint64_t> iteration_num;
+    std::atomic<double> max_residual;
+    std::array<std::atomic<std::uint64_t>, RESIDUAL_BIN_NUM> residual_histogram;
+  };
+  mutable ThreadBlocks<RefinementCounters> refinement_counters_;
 
-  bool isPoseReachable(const geometry_msgs::Pose& pose) const;
+  void computeIkTarget(const geometry_msgs::Pose& ik_pose, IkTarget& target) const;
 
-  bool isSolutionValid(const std::vector<double>& solution) const;
+  void publishIkStatistics() const;
+
+  // Weighted squared distance between two solutions
+  double getJointDistance(const JointValues& a, const JointValues& b) const;
+
+  // Weighted squared distance between the solution and the seed state
+  double getSeedDistance(const JointValues& solution, const std::vector<double>& ik_seed_state) const;
+
+  int getLinkIndex(const std::string& link_name) const;
+
+  // Refines the candidate towards the target until it is within the solution tolerance, returns false if it does not
+  // get there within the iterations or before the deadline. is_timed_out tells the latter.
+  bool refineSolution(JointValues& solution, const IkTarget& target, const ros::WallTime& deadline,
+                      bool& is_timed_out) const;
+
+  void resetRefinementStatistics();
+
+  // ik_pose, or its projection if the options ask for an approximate solution. False if the orientation is not
+  // reachable and the options ask for an exact solution.
+  bool getSolvablePose(const geometry_msgs::Pose& ik_pose, const kinematics::KinematicsQueryOptions& options,
+                       geometry_msgs::Pose& pose) const;
+
+  bool isSolutionConsistent(const JointValues& solution, const std::vector<double>& ik_seed_state,
+                            const std::vector<double>& consistency_limits) const;
+
+  bool isSolutionValid(const JointValues& solution) const;
 
   void quaternionToRpy(const geometry_msgs::Quaternion& q, double& roll, double& pitch, double& yaw) const;
 
-  bool revisePose(geometry_msgs::Pose& pose) const;
+  void rpyToQuaternion(double roll, double pitch, double yaw, geometry_msgs::Quaternion& q) const;
+
+  // Follows the Jacobian from the seed state, so the solution stays on the branch of the seed. Fails if the target is
+  // far from the seed, near a singularity or beyond the limits, the closed-form solution then re-anchors.
+  bool solveIkDifferential(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+                           const std::vector<double>& consistency_limits, JointValues& solution) const;
+
+  // The distinct valid and exact candidates of the pose, returns their number. free_theta1 is theta1 where the pose
+  // leaves it free, see XarmKinematicsCore::computeSolutions(). The refinement stops at the deadline, is_truncated then
+  // tells whether candidates were dropped that it might have refined with more time.
+  int solveIkExact(const geometry_msgs::Pose& ik_pose, double free_theta1, const ros::WallTime& deadline,
+                   Candidates& solutions, bool* is_truncated = nullptr) const;
 
-  bool solveIk(const geometry_msgs::Pose& ik_pose, std::vector<double>& solution) const;
+  // solveIkExact() through the reachability map and the IK cache, which only keeps complete results
+  void findExactSolutions(const geometry_msgs::Pose& ik_pose, double free_theta1, const ros::WallTime& deadline,
+                          ExactSolutions& exact) const;
 
-  bool solveIkFromAllPossibleSolutions(const geometry_msgs::Pose& ik_pose, std::vector<double>& solution) const;
+  // The distinct valid, exact and consistent candidates sorted by the distance to the seed state, returns their number
+  int solveIkSortedBySeed(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
+                          const std::vector<double>& consistency_limits, const ros::WallTime& deadline,
+                          Candidates& solutions) const;
 };
 
 }  // namespace xarm_kinematics_plugin
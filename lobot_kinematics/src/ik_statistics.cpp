@@ -0,0 +1,258 @@
+#include "xarm_kinematics_plugin/ik_statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <string>
+
+namespace xarm_kinematics_plugin
+{
+namespace
+{
+std::string formatMicroseconds(std::uint64_t latency_ns)
+{
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.1f", latency_ns * 1e-3);
+  return text;
+}
+
+void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const std::string& value)
+{
+  diagnostic_msgs::KeyValue key_value;
+  key_value.key = key;
+  key_value.value = value;
+  status.values.push_back(key_value);
+}
+}  // namespace
+
+constexpr int IkStatistics::SUB_BUCKET_BITS;
+constexpr int IkStatistics::SUB_BUCKET_NUM;
+constexpr int IkStatistics::BUCKET_NUM;
+constexpr int IkStatistics::SINGULARITY_NUM;
+
+std::uint64_t IkStatistics::Snapshot::getCallNum(Result result, Branch branch) const
+{
+  const auto& histogram = latency_histograms[result][branch];
+  return std::accumulate(histogram.cbegin(), histogram.cend(), std::uint64_t(0));
+}
+
+std::uint64_t IkStatistics::Snapshot::getLatencyQuantile(Result result, Branch branch, double quantile) const
+{
+  const auto call_num = getCallNum(result, branch);
+  if (call_num == 0)
+  {
+    return 0;
+  }
+
+  // The bucket of the call with the rank of the quantile, counted from 1
+  const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(quantile * call_num)));
+  const auto& histogram = latency_histograms[result][branch];
+  std::uint64_t count = 0;
+  for (auto bucket = 0; bucket < BUCKET_NUM; ++bucket)
+  {
+    count += histogram[bucket];
+    if (count >= rank)
+    {
+      return getBucketUpperBound(bucket);
+    }
+  }
+  return getBucketUpperBound(BUCKET_NUM - 1);
+}
+
+void IkStatistics::recordCall(Result result, Branch branch, std::uint64_t latency_ns)
+{
+  thread_counters_.get().latency_histograms[result][branch][getBucket(latency_ns)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void IkStatistics::recordCandidates(std::uint32_t nan_mask, std::uint32_t exact_mask)
+{
+  auto& counters = thread_counters_.get();
+  for (; nan_mask != 0; nan_mask &= nan_mask - 1)
+  {
+    counters.nan_candidate_nums[__builtin_ctz(nan_mask)].fetch_add(1, std::memory_order_relaxed);
+  }
+  for (; exact_mask != 0; exact_mask &= exact_mask - 1)
+  {
+    counters.exact_candidate_nums[__builtin_ctz(exact_mask)].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void IkStatistics::recordSingularity(int singularity)
+{
+  thread_counters_.get().singularity_nums[singularity].fetch_add(1, std::memory_order_relaxed);
+}
+
+void IkStatistics::getSnapshot(Snapshot& snapshot) const
+{
+  snapshot = Snapshot();
+
+  thread_counters_.forEach([&](const ThreadCounters& counters) {
+    for (auto result = 0; result < RESULT_NUM; ++result)
+    {
+      for (auto branch = 0; branch < BRANCH_NUM; ++branch)
+      {
+        for (auto bucket = 0; bucket < BUCKET_NUM; ++bucket)
+        {
+          snapshot.latency_histograms[result][branch][bucket] +=
+              counters.latency_histograms[result][branch][bucket].load(std::memory_order_relaxed);
+        }
+      }
+    }
+    for (auto index = 0; index < CANDIDATE_NUM; ++index)
+    {
+      snapshot.nan_candidate_nums[index] += counters.nan_candidate_nums[index].load(std::memory_order_relaxed);
+      snapshot.exact_candidate_nums[index] += counters.exact_candidate_nums[index].load(std::memory_order_relaxed);
+    }
+    for (auto singularity = 0; singularity < SINGULARITY_NUM; ++singularity)
+    {
+      snapshot.singularity_nums[singularity] += counters.singularity_nums[singularity].load(std::memory_order_relaxed);
+    }
+  });
+}
+
+void IkStatistics::reset()
+{
+  thread_counters_.forEach(clear);
+}
+
+void IkStatistics::toDiagnosticStatus(const Snapshot& snapshot, diagnostic_msgs::DiagnosticStatus& status)
+{
+  typedef XarmKinematicsCore<double> Kinematics;
+
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.values.clear();
+
+  std::uint64_t total_call_num = 0;
+  for (auto result = 0; result < RESULT_NUM; ++result)
+  {
+    for (auto branch = 0; branch < BRANCH_NUM; ++branch)
+    {
+      const auto r = static_cast<Result>(result);
+      const auto b = static_cast<Branch>(branch);
+      const auto call_num = snapshot.getCallNum(r, b);
+      if (call_num == 0)
+      {
+        continue;
+      }
+
+      total_call_num += call_num;
+      addValue(status, std::string(getResultName(r)) + " " + getBranchName(b),
+               std::to_string(call_num) + " calls, p50 " + formatMicroseconds(snapshot.getLatencyQuantile(r, b, 0.5)) +
+                   " us, p99 " + formatMicroseconds(snapshot.getLatencyQuantile(r, b, 0.99)) + " us, max " +
+                   formatMicroseconds(snapshot.getLatencyQuantile(r, b, 1.0)) + " us");
+    }
+  }
+
+  for (auto index = 0; index < CANDIDATE_NUM; ++index)
+  {
+    if (snapshot.nan_candidate_nums[index] > 0 || snapshot.exact_candidate_nums[index] > 0)
+    {
+      addValue(status, "candidate " + std::to_string(index),
+               std::to_string(snapshot.nan_candidate_nums[index]) + " NaN, " +
+                   std::to_string(snapshot.exact_candidate_nums[index]) + " exact");
+    }
+  }
+
+  for (auto singularity = 0; singularity < SINGULARITY_NUM; ++singularity)
+  {
+    if (snapshot.singularity_nums[singularity] > 0)
+    {
+      addValue(status, Kinematics::getSingularityName(static_cast<Kinematics::Singularity>(singularity)),
+               std::to_string(snapshot.singularity_nums[singularity]) + " targets");
+    }
+  }
+
+  status.message = std::to_string(total_call_num) + " IK calls";
+}
+
+int IkStatistics::getBucket(std::uint64_t latency_ns)
+{
+  if (latency_ns < SUB_BUCKET_NUM)
+  {
+    return static_cast<int>(latency_ns);
+  }
+
+  // The highest bit selects the power of two, the next SUB_BUCKET_BITS bits the sub-bucket
+  const auto msb = 63 - __builtin_clzll(latency_ns);
+  const auto bucket = (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKET_NUM +
+                      static_cast<int>((latency_ns >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKET_NUM - 1));
+  return std::min(bucket, BUCKET_NUM - 1);
+}
+
+std::uint64_t IkStatistics::getBucketUpperBound(int bucket)
+{
+  if (bucket < SUB_BUCKET_NUM)
+  {
+    return bucket;
+  }
+
+  const auto msb = bucket / SUB_BUCKET_NUM + SUB_BUCKET_BITS - 1;
+  const auto sub_bucket = static_cast<std::uint64_t>(bucket % SUB_BUCKET_NUM);
+  return ((SUB_BUCKET_NUM + sub_bucket + 1) << (msb - SUB_BUCKET_BITS)) - 1;
+}
+
+const char* IkStatistics::getResultName(Result result)
+{
+  switch (result)
+  {
+    case SUCCESS:
+      return "success";
+    case NO_SOLUTION:
+      return "no solution";
+    case TIMED_OUT:
+      return "timed out";
+    case OTHER_ERROR:
+      return "other error";
+    default:
+      return "unknown";
+  }
+}
+
+const char* IkStatistics::getBranchName(Branch branch)
+{
+  switch (branch)
+  {
+    case ELBOW_POSITIVE:
+      return "elbow +";
+    case ELBOW_NEGATIVE:
+      return "elbow -";
+    case OVER_ELBOW_POSITIVE:
+      return "over the Z axis, elbow +";
+    case OVER_ELBOW_NEGATIVE:
+      return "over the Z axis, elbow -";
+    case NO_BRANCH:
+      return "no branch";
+    default:
+      return "unknown";
+  }
+}
+
+void IkStatistics::clear(ThreadCounters& counters)
+{
+  for (auto& branch_histograms : counters.latency_histograms)
+  {
+    for (auto& histogram : branch_histograms)
+    {
+      for (auto& count : histogram)
+      {
+        count.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+  for (auto& count : counters.nan_candidate_nums)
+  {
+    count.store(0, std::memory_order_relaxed);
+  }
+  for (auto& count : counters.exact_candidate_nums)
+  {
+    count.store(0, std::memory_order_relaxed);
+  }
+  for (auto& count : counters.singularity_nums)
+  {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace xarm_kinematics_plugin
@@ -0,0 +1,180 @@
+#include "xarm_kinematics_plugin/reachability_map.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace xarm_kinematics_plugin
+{
+namespace
+{
+constexpr char map_magic[8] = { 'X', 'A', 'R', 'M', 'R', 'M', 'A', 'P' };
+constexpr std::uint32_t map_version = 1;
+}  // namespace
+
+ReachabilityMap::ReachabilityMap() : header_(), bits_(nullptr), mapping_(nullptr), mapping_size_(0)
+{
+}
+
+ReachabilityMap::~ReachabilityMap()
+{
+  unload();
+}
+
+void ReachabilityMap::create(const std::array<double, 3>& origin, const std::array<std::int32_t, 3>& cell_num,
+                             double resolution, std::uint32_t pitch_bin_num)
+{
+  unload();
+
+  std::memcpy(header_.magic, map_magic, sizeof(map_magic));
+  header_.version = map_version;
+  header_.pitch_bin_num = pitch_bin_num;
+  header_.cell_num = cell_num;
+  header_.origin = origin;
+  header_.resolution = resolution;
+
+  owned_bits_.assign(getByteNum(), 0);
+  bits_ = owned_bits_.data();
+}
+
+bool ReachabilityMap::load(const std::string& path)
+{
+  unload();
+
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || static_cast<std::size_t>(file_stat.st_size) < sizeof(Header))
+  {
+    close(fd);
+    return false;
+  }
+
+  const auto size = static_cast<std::size_t>(file_stat.st_size);
+  const auto mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);  // The mapping stays valid
+  if (mapping == MAP_FAILED)
+  {
+    return false;
+  }
+
+  std::memcpy(&header_, mapping, sizeof(Header));
+  const auto is_valid = std::memcmp(header_.magic, map_magic, sizeof(map_magic)) == 0 &&
+                        header_.version == map_version && header_.pitch_bin_num > 0 && header_.resolution > 0 &&
+                        std::all_of(header_.cell_num.cbegin(), header_.cell_num.cend(),
+                                    [](std::int32_t n) { return n > 0; }) &&
+                        size == sizeof(Header) + getByteNum();
+  if (!is_valid)
+  {
+    munmap(mapping, size);
+    header_ = Header();
+    return false;
+  }
+
+  mapping_ = mapping;
+  mapping_size_ = size;
+  bits_ = static_cast<const std::uint8_t*>(mapping) + sizeof(Header);
+  return true;
+}
+
+bool ReachabilityMap::save(const std::string& path) const
+{
+  if (!isLoaded())
+  {
+    return false;
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(&header_), sizeof(Header));
+  file.write(reinterpret_cast<const char*>(bits_), getByteNum());
+  return static_cast<bool>(file);
+}
+
+bool ReachabilityMap::isReachable(const geometry_msgs::Pose& pose) const
+{
+  const std::array<double, 3> position{ { pose.position.x, pose.position.y, pose.position.z } };
+  std::array<std::int32_t, 3> cell;
+  for (auto i = 0; i < 3; ++i)
+  {
+    const auto index = std::floor((position[i] - header_.origin[i]) / header_.resolution);
+    if (!(index >= 0 && index < header_.cell_num[i]))  // Also rejects NaN
+    {
+      return false;
+    }
+    cell[i] = static_cast<std::int32_t>(index);
+  }
+
+  return isReachable(cell, getPitchBin(getApproachPitch(pose.orientation)));
+}
+
+bool ReachabilityMap::isReachable(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin) const
+{
+  const auto bit = getBitIndex(cell, pitch_bin);
+  return (bits_[bit / 8] >> (bit % 8)) & 1;
+}
+
+void ReachabilityMap::setReachable(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin)
+{
+  const auto bit = getBitIndex(cell, pitch_bin);
+  owned_bits_[bit / 8] |= 1 << (bit % 8);
+}
+
+double ReachabilityMap::getApproachPitch(const geometry_msgs::Quaternion& q)
+{
+  // Z component of the X axis of the rotation, the same as -pitch of the RPY angles used by the IK
+  const auto x_axis_z = 2 * (q.x * q.z - q.w * q.y);
+  return std::asin(std::max(-1.0, std::min(1.0, x_axis_z)));
+}
+
+std::int32_t ReachabilityMap::getPitchBin(double pitch) const
+{
+  const auto bin = static_cast<std::int32_t>((pitch + M_PI / 2) / M_PI * header_.pitch_bin_num);
+  return std::max<std::int32_t>(0, std::min<std::int32_t>(header_.pitch_bin_num - 1, bin));
+}
+
+void ReachabilityMap::getCellCenter(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin,
+                                    std::array<double, 3>& position, double& pitch) const
+{
+  for (auto i = 0; i < 3; ++i)
+  {
+    position[i] = header_.origin[i] + (cell[i] + 0.5) * header_.resolution;
+  }
+  pitch = (pitch_bin + 0.5) * M_PI / header_.pitch_bin_num - M_PI / 2;
+}
+
+void ReachabilityMap::unload()
+{
+  if (mapping_)
+  {
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+  }
+  owned_bits_.clear();
+  bits_ = nullptr;
+}
+
+std::size_t ReachabilityMap::getBitIndex(const std::array<std::int32_t, 3>& cell, std::int32_t pitch_bin) const
+{
+  return ((static_cast<std::size_t>(cell[0]) * header_.cell_num[1] + cell[1]) * header_.cell_num[2] + cell[2]) *
+             header_.pitch_bin_num +
+         pitch_bin;
+}
+
+std::size_t ReachabilityMap::getByteNum() const
+{
+  const auto bit_num = static_cast<std::size_t>(header_.cell_num[0]) * header_.cell_num[1] * header_.cell_num[2] *
+                       header_.pitch_bin_num;
+  return (bit_num + 7) / 8;
+}
+
+}  // namespace xarm_kinematics_plugin
@@ -0,0 +1,141 @@
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/robot_state/robot_state.h>
+#include <ros/ros.h>
+#include <chrono>
+#include <random>
+
+#include "xarm_kinematics_plugin/benchmark_poses.h"
+#include "xarm_kinematics_plugin/simd_math.h"
+#include "xarm_kinematics_plugin/xarm_kinematics_plugin.h"
+
+namespace benchmark_poses = xarm_kinematics_plugin::benchmark_poses;
+
+namespace
+{
+constexpr int sample_num = 100000;
+
+// Average time of fn over all samples, in nanoseconds
+template <typename Fn>
+double measure(const std::vector<std::vector<double>>& samples, Fn&& fn)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& sample : samples)
+  {
+    fn(sample);
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / samples.size();
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "xarm_kinematics_benchmark");
+  ros::NodeHandle nh;
+
+  robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+  const auto robot_model = robot_model_loader.getModel();
+  const auto joint_model_group = robot_model->getJointModelGroup("xarm_arm");
+  const auto& tip_link = joint_model_group->getLinkModelNames().back();
+
+  xarm_kinematics_plugin::XarmKinematicsPlugin plugin;
+  if (!plugin.initialize(*robot_model, "xarm_arm", "base_link", { tip_link }, 0.005))
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_benchmark", "Failed to initialize the kinematics plugin");
+    return 1;
+  }
+
+  // Random joint values within the limits
+  moveit::core::RobotState robot_state(robot_model);
+  std::vector<std::vector<double>> samples(sample_num);
+  for (auto& sample : samples)
+  {
+    robot_state.setToRandomPositions(joint_model_group);
+    robot_state.copyJointGroupPositions(joint_model_group, sample);
+  }
+
+  // Checksums keep the compiler from dropping the measured calls
+  double checksum = 0;
+
+  const auto robot_state_ns = measure(samples, [&](const std::vector<double>& sample) {
+    robot_state.setJointGroupPositions(joint_model_group, sample);
+    robot_state.update();
+    checksum += robot_state.getGlobalLinkTransform(tip_link).translation().x();
+  });
+
+  std::array<geometry_msgs::Pose, LINK_NUM> link_poses;
+  const auto compute_fk_ns = measure(samples, [&](const std::vector<double>& sample) {
+    plugin.computeFk(sample.data(), link_poses);
+    checksum -= link_poses.back().position.x;
+  });
+
+  const std::vector<std::string> link_names{ tip_link };
+  std::vector<geometry_msgs::Pose> poses;
+  const auto get_position_fk_ns = measure(samples, [&](const std::vector<double>& sample) {
+    plugin.getPositionFK(link_names, sample, poses);
+    checksum -= poses.back().position.x;
+  });
+
+  // IK of the tool poses reached by the samples
+  std::vector<geometry_msgs::Pose> ik_poses(sample_num);
+  for (auto i = 0; i < sample_num; ++i)
+  {
+    plugin.computeToolPose(samples[i].data(), ik_poses[i]);
+  }
+
+  auto ik_pose_it = ik_poses.cbegin();
+  int ik_success_num = 0;
+  std::vector<double> solution(JOINT_NUM);
+  moveit_msgs::MoveItErrorCodes error_code;
+  const auto search_position_ik_ns = measure(samples, [&](const std::vector<double>& sample) {
+    ik_success_num += plugin.searchPositionIK(*ik_pose_it++, sample, 0.005, solution, error_code);
+  });
+
+  // Steps of a Cartesian path, the seeds are 0.01 rad away from the samples, i.e. a few mm
+  std::vector<std::vector<double>> near_seeds(samples);
+  for (auto& near_seed : near_seeds)
+  {
+    for (auto& joint_value : near_seed)
+    {
+      joint_value += 0.01;
+    }
+  }
+  ik_pose_it = ik_poses.cbegin();
+  int near_success_num = 0;
+  const auto near_seed_ns = measure(near_seeds, [&](const std::vector<double>& near_seed) {
+    near_success_num += plugin.searchPositionIK(*ik_pose_it++, near_seed, 0.005, solution, error_code);
+  });
+
+  std::vector<xarm_kinematics_plugin::XarmKinematicsPlugin::BatchSolution> batch_solutions(sample_num);
+  const auto batch_start = std::chrono::steady_clock::now();
+  plugin.solveBatch(ik_poses.data(), ik_poses.size(), batch_solutions.data());
+  const auto batch_end = std::chrono::steady_clock::now();
+  const auto solve_batch_ns = std::chrono::duration<double, std::nano>(batch_end - batch_start).count() / sample_num;
+  // Only solutions that reach their pose count
+  int batch_success_num = 0;
+  for (auto i = 0; i < sample_num; ++i)
+  {
+    const auto& batch_solution = batch_solutions[i];
+    batch_success_num +=
+        batch_solution.found && benchmark_poses::isSolutionOf(batch_solution.joint_values, ik_poses[i]);
+  }
+
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "FK of %s over %d samples (checksum %g):", tip_link.c_str(), sample_num,
+                 checksum);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "  RobotState::getGlobalLinkTransform: %8.1f ns", robot_state_ns);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "  XarmKinematicsPlugin::computeFk:     %8.1f ns", compute_fk_ns);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "  XarmKinematicsPlugin::getPositionFK: %8.1f ns", get_position_fk_ns);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "IK of the tool pose over %d samples (%d solved):", sample_num,
+                 ik_success_num);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "  XarmKinematicsPlugin::searchPositionIK: %8.1f ns",
+                 search_position_ik_ns);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark",
+                 "  XarmKinematicsPlugin::searchPositionIK from a near seed: %8.1f ns (%d solved)", near_seed_ns,
+                 near_success_num);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "Batched IK with %d lanes over %d samples (%d solved):", SIMD_LANES,
+                 sample_num, batch_success_num);
+  ROS_INFO_NAMED("xarm_kinematics_benchmark", "  XarmKinematicsPlugin::solveBatch: %8.1f ns, %.0f poses/s",
+                 solve_batch_ns, 1e9 / solve_batch_ns);
+
+  return 0;
+}
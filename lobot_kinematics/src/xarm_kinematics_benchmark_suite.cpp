@@ -0,0 +1,363 @@
+#include <benchmark/benchmark.h>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainiksolverpos_lma.hpp>
+#include <kdl_parser/kdl_parser.hpp>
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <ros/ros.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xarm_kinematics_plugin/benchmark_poses.h"
+#include "xarm_kinematics_plugin/xarm_kinematics_plugin.h"
+
+using xarm_kinematics_plugin::XarmKinematicsPlugin;
+namespace benchmark_poses = xarm_kinematics_plugin::benchmark_poses;
+
+namespace
+{
+constexpr int pose_num = 1000;
+
+// Settings of KDL::ChainIkSolverPos_LMA
+constexpr double kdl_eps = 1e-5;
+constexpr int kdl_max_iterations = 500;
+
+// Shared by the benchmarks, set up in main() before they run
+struct BenchmarkData
+{
+  XarmKinematicsPlugin plugin;
+  std::string tip_link;
+
+  // Joint values of the uniform pose set for the FK
+  std::vector<benchmark_poses::Kinematics::JointValues> joint_samples;
+  std::array<std::vector<geometry_msgs::Pose>, benchmark_poses::POSE_SET_NUM> pose_sets;
+
+  // The chain from base_link to the tool point of computeToolPose()
+  KDL::Chain kdl_chain;
+};
+
+std::unique_ptr<BenchmarkData> data;
+
+KDL::Frame toKdlFrame(const geometry_msgs::Pose& pose)
+{
+  return KDL::Frame(
+      KDL::Rotation::Quaternion(pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w),
+      KDL::Vector(pose.position.x, pose.position.y, pose.position.z));
+}
+
+// The KDL chain of the URDF of the robot model extended by the fixed offset from the tip link to the tool point
+bool initializeKdlChain(const moveit::core::RobotModel& robot_model)
+{
+  KDL::Tree tree;
+  if (!kdl_parser::treeFromUrdfModel(*robot_model.getURDF(), tree) ||
+      !tree.getChain("base_link", data->tip_link, data->kdl_chain) || data->kdl_chain.getNrOfJoints() != JOINT_NUM)
+  {
+    return false;
+  }
+
+  const benchmark_poses::Kinematics::JointValues zero{};
+  KDL::JntArray joint_array(JOINT_NUM);
+  KDL::Frame tip_frame;
+  KDL::ChainFkSolverPos_recursive fk_solver(data->kdl_chain);
+  if (fk_solver.JntToCart(joint_array, tip_frame) < 0)
+  {
+    return false;
+  }
+  const auto tool_frame = toKdlFrame(benchmark_poses::computeToolPose(zero));
+  data->kdl_chain.addSegment(KDL::Segment(KDL::Joint(KDL::Joint::None), tip_frame.Inverse() * tool_frame));
+  return true;
+}
+
+// Pose set of the argument of the benchmark, the benchmarks of one pose per iteration cycle through it
+const std::vector<geometry_msgs::Pose>& getPoses(const benchmark::State& state)
+{
+  return data->pose_sets[state.range(0)];
+}
+
+void setSolvedRate(benchmark::State& state, std::int64_t solved_num, std::int64_t pose_count)
+{
+  state.SetItemsProcessed(pose_count);
+  state.counters["solved"] = pose_count > 0 ? static_cast<double>(solved_num) / pose_count : 0;
+}
+
+void computeFk(benchmark::State& state)
+{
+  std::array<geometry_msgs::Pose, LINK_NUM> link_poses;
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    data->plugin.computeFk(data->joint_samples[i++ % pose_num].data(), link_poses);
+    benchmark::DoNotOptimize(link_poses);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void getPositionFk(benchmark::State& state)
+{
+  const std::vector<std::string> link_names{ data->tip_link };
+  std::vector<double> joint_values(JOINT_NUM);
+  std::vector<geometry_msgs::Pose> poses;
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    const auto& sample = data->joint_samples[i++ % pose_num];
+    joint_values.assign(sample.cbegin(), sample.cend());
+    data->plugin.getPositionFK(link_names, joint_values, poses);
+    benchmark::DoNotOptimize(poses);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void kdlFk(benchmark::State& state)
+{
+  KDL::ChainFkSolverPos_recursive fk_solver(data->kdl_chain);
+  KDL::JntArray joint_array(JOINT_NUM);
+  KDL::Frame frame;
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    const auto& sample = data->joint_samples[i++ % pose_num];
+    for (auto j = 0; j < JOINT_NUM; ++j)
+    {
+      joint_array(j) = sample[j];
+    }
+    fk_solver.JntToCart(joint_array, frame);
+    benchmark::DoNotOptimize(frame);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// The single solution closest to the seed, the home pose
+void searchPositionIk(benchmark::State& state)
+{
+  const auto& poses = getPoses(state);
+  const std::vector<double> seed(JOINT_NUM, 0);
+  std::vector<double> solution(JOINT_NUM);
+  moveit_msgs::MoveItErrorCodes error_code;
+  std::int64_t solved_num = 0;
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    solved_num += data->plugin.searchPositionIK(poses[i++ % poses.size()], seed, 0.005, solution, error_code);
+  }
+  setSolvedRate(state, solved_num, state.iterations());
+}
+
+// searchPositionIK() of the uniform poses from several threads on the same plugin, the throughput should scale with
+// the threads up to the number of cores
+void searchPositionIkThreads(benchmark::State& state)
+{
+  const auto& poses = data->pose_sets[benchmark_poses::UNIFORM];
+  const std::vector<double> seed(JOINT_NUM, 0);
+  std::vector<double> solution(JOINT_NUM);
+  moveit_msgs::MoveItErrorCodes error_code;
+  std::int64_t solved_num = 0;
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    solved_num += data->plugin.searchPositionIK(poses[i++ % poses.size()], seed, 0.005, solution, error_code);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["solved"] =
+      benchmark::Counter(static_cast<double>(solved_num) / state.iterations(), benchmark::Counter::kAvgThreads);
+}
+
+// All solutions sorted by the distance to the seed, i.e. solveIkExact() through the IK cache and the reachability map
+void getPositionIkAllSolutions(benchmark::State& state)
+{
+  const auto& poses = getPoses(state);
+  const std::vector<double> seed(JOINT_NUM, 0);
+  std::vector<geometry_msgs::Pose> ik_poses(1);
+  std::vector<std::vector<double>> solutions;
+  kinematics::KinematicsResult result;
+  const kinematics::KinematicsQueryOptions options;
+  std::int64_t solved_num = 0;
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    ik_poses[0] = poses[i++ % poses.size()];
+    solved_num += data->plugin.getPositionIK(ik_poses, seed, solutions, result, options);
+  }
+  setSolvedRate(state, solved_num, state.iterations());
+}
+
+// Solved rate of the last solutions of all poses, counting only those that reach their pose
+void setBatchSolvedRate(benchmark::State& state, const std::vector<geometry_msgs::Pose>& poses,
+                        const std::vector<XarmKinematicsPlugin::BatchSolution>& solutions, std::int64_t pose_count)
+{
+  std::int64_t solved_num = 0;
+  for (std::size_t i = 0; i < poses.size(); ++i)
+  {
+    solved_num += solutions[i].found && benchmark_poses::isSolutionOf(solutions[i].joint_values, poses[i]);
+  }
+  state.SetItemsProcessed(pose_count);
+  state.counters["solved"] = poses.empty() ? 0 : static_cast<double>(solved_num) / poses.size();
+}
+
+// solveBatch() of one pose per call
+void solveBatchSingle(benchmark::State& state)
+{
+  const auto& poses = getPoses(state);
+  std::vector<XarmKinematicsPlugin::BatchSolution> solutions(poses.size());
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    const auto j = i++ % poses.size();
+    data->plugin.solveBatch(&poses[j], 1, &solutions[j]);
+  }
+  setBatchSolvedRate(state, poses, solutions, state.iterations());
+}
+
+// solveBatch() of the whole set per iteration
+void solveBatch(benchmark::State& state)
+{
+  const auto& poses = getPoses(state);
+  std::vector<XarmKinematicsPlugin::BatchSolution> solutions(poses.size());
+  for (auto _ : state)
+  {
+    data->plugin.solveBatch(poses.data(), poses.size(), solutions.data());
+    benchmark::DoNotOptimize(solutions.data());
+  }
+  setBatchSolvedRate(state, poses, solutions, state.iterations() * poses.size());
+}
+
+// The numerical baseline from the same seed, without the joint limits
+void kdlIk(benchmark::State& state)
+{
+  const auto& poses = getPoses(state);
+  KDL::ChainIkSolverPos_LMA ik_solver(data->kdl_chain, kdl_eps, kdl_max_iterations);
+  const KDL::JntArray seed(JOINT_NUM);
+  KDL::JntArray solution(JOINT_NUM);
+  std::int64_t solved_num = 0;
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    const auto error = ik_solver.CartToJnt(seed, toKdlFrame(poses[i++ % poses.size()]), solution);
+    solved_num += error == KDL::SolverI::E_NOERROR;
+  }
+  setSolvedRate(state, solved_num, state.iterations());
+}
+
+// Whether solveBatch() solves the same poses of every set as searchPositionIK(), and both reach them, so that their
+// solved rates and times compare
+bool checkBatchConsistency()
+{
+  const std::vector<double> seed(JOINT_NUM, 0);
+  std::vector<double> solution(JOINT_NUM);
+  moveit_msgs::MoveItErrorCodes error_code;
+  auto is_consistent = true;
+  for (auto pose_set = 0; pose_set < benchmark_poses::POSE_SET_NUM; ++pose_set)
+  {
+    const auto& poses = data->pose_sets[pose_set];
+    std::vector<XarmKinematicsPlugin::BatchSolution> batch_solutions(poses.size());
+    data->plugin.solveBatch(poses.data(), poses.size(), batch_solutions.data());
+
+    int mismatch_num = 0, inexact_num = 0;
+    for (std::size_t i = 0; i < poses.size(); ++i)
+    {
+      const auto& batch_solution = batch_solutions[i];
+      const auto found = data->plugin.searchPositionIK(poses[i], seed, 0.005, solution, error_code);
+      mismatch_num += found != batch_solution.found;
+
+      benchmark_poses::Kinematics::JointValues joint_values;
+      std::copy(solution.cbegin(), solution.cend(), joint_values.begin());
+      inexact_num += (found && !benchmark_poses::isSolutionOf(joint_values, poses[i])) ||
+                     (batch_solution.found && !benchmark_poses::isSolutionOf(batch_solution.joint_values, poses[i]));
+    }
+
+    if (mismatch_num != 0 || inexact_num != 0)
+    {
+      ROS_ERROR_NAMED("xarm_kinematics_benchmark_suite",
+                      "Of the %s poses solveBatch and searchPositionIK disagree on %d, %d solutions miss the pose",
+                      benchmark_poses::getPoseSetName(static_cast<benchmark_poses::PoseSet>(pose_set)), mismatch_num,
+                      inexact_num);
+      is_consistent = false;
+    }
+  }
+  return is_consistent;
+}
+
+void registerIkBenchmark(const char* name, void (*fn)(benchmark::State&))
+{
+  for (auto pose_set = 0; pose_set < benchmark_poses::POSE_SET_NUM; ++pose_set)
+  {
+    const auto set_name = benchmark_poses::getPoseSetName(static_cast<benchmark_poses::PoseSet>(pose_set));
+    benchmark::RegisterBenchmark((std::string(name) + "/" + set_name).c_str(), fn)->Arg(pose_set);
+  }
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "xarm_kinematics_benchmark_suite");
+  ros::NodeHandle nh;
+
+  // E.g. --benchmark_out=<file> --benchmark_out_format=json for tracking the results
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+  {
+    return 1;
+  }
+
+  robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+  const auto robot_model = robot_model_loader.getModel();
+  const auto joint_model_group = robot_model->getJointModelGroup("xarm_arm");
+
+  data.reset(new BenchmarkData);
+  data->tip_link = joint_model_group->getLinkModelNames().back();
+  if (!data->plugin.initialize(*robot_model, "xarm_arm", "base_link", { data->tip_link }, 0.005))
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_benchmark_suite", "Failed to initialize the kinematics plugin");
+    return 1;
+  }
+  if (!initializeKdlChain(*robot_model))
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_benchmark_suite", "Failed to build the KDL chain from base_link to %s",
+                    data->tip_link.c_str());
+    return 1;
+  }
+
+  for (auto pose_set = 0; pose_set < benchmark_poses::POSE_SET_NUM; ++pose_set)
+  {
+    data->pose_sets[pose_set] =
+        benchmark_poses::generatePoses(static_cast<benchmark_poses::PoseSet>(pose_set), pose_num);
+  }
+
+  // The same generator as the uniform pose set
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<double> unit(0, 1);
+  data->joint_samples.resize(pose_num);
+  for (auto& sample : data->joint_samples)
+  {
+    for (auto j = 0; j < JOINT_NUM; ++j)
+    {
+      sample[j] = benchmark_poses::lower_limits[j] +
+                  (benchmark_poses::upper_limits[j] - benchmark_poses::lower_limits[j]) * unit(generator);
+    }
+  }
+
+  if (!checkBatchConsistency())
+  {
+    return 1;
+  }
+
+  benchmark::RegisterBenchmark("FK/computeFk", computeFk);
+  benchmark::RegisterBenchmark("FK/getPositionFK", getPositionFk);
+  benchmark::RegisterBenchmark("FK/KDL", kdlFk);
+  registerIkBenchmark("IK/searchPositionIK", searchPositionIk);
+  benchmark::RegisterBenchmark("IK/searchPositionIK_threads/uniform", searchPositionIkThreads)
+      ->ThreadRange(1, std::max(1u, std::thread::hardware_concurrency()))
+      ->UseRealTime();
+  registerIkBenchmark("IK/getPositionIK_all", getPositionIkAllSolutions);
+  registerIkBenchmark("IK/solveBatch_single", solveBatchSingle);
+  registerIkBenchmark("IK/solveBatch", solveBatch);
+  registerIkBenchmark("IK/KDL_LMA", kdlIk);
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "xarm_kinematics_plugin/xarm_kinematics_core.h"
+
+using xarm_kinematics_plugin::XarmKinematicsCore;
+
+namespace
+{
+constexpr int sample_num = 100000;
+
+// Joint limits of xarm.urdf
+constexpr double lower_limits[JOINT_NUM] = { -2.09439510239, -1.57079632679, -2.09439510239, -2.09439510239,
+                                             -2.09439510239 };
+constexpr double upper_limits[JOINT_NUM] = { 2.09439510239, 1.57079632679, 2.09439510239, 2.09439510239,
+                                             2.09439510239 };
+
+typedef XarmKinematicsCore<double> Reference;
+
+struct Sample
+{
+  Reference::JointValues joint_values;
+  std::array<double, 3> position;
+  std::array<double, 4> orientation;
+};
+
+struct Result
+{
+  double solve_ns;            // Average time of one IK, in nanoseconds
+  int solved_num;             // Samples with an exact candidate within the limits
+  double max_position_error;  // Of the tool point reached by the solutions in meters, evaluated in double
+  double mean_position_error;
+  double checksum;
+};
+
+// IK of every sample with the Scalar kernel, the solution is the exact candidate within the limits closest to the
+// sample
+template <typename Scalar>
+Result run(const std::vector<Sample>& samples, Scalar tolerance)
+{
+  typedef XarmKinematicsCore<Scalar> Kinematics;
+
+  std::vector<typename Kinematics::JointValues> solutions(samples.size());
+  std::vector<bool> found(samples.size());
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < samples.size(); ++i)
+  {
+    const auto& sample = samples[i];
+    Scalar roll, pitch, yaw;
+    Kinematics::quaternionToRpy(sample.orientation[0], sample.orientation[1], sample.orientation[2],
+                                sample.orientation[3], roll, pitch, yaw);
+    Kinematics::projectOrientation(std::atan2(sample.position[1], sample.position[0]), roll, pitch, yaw, roll, pitch);
+
+    typename Kinematics::Target target;
+    Kinematics::computeTarget(sample.position[0], sample.position[1], sample.position[2], roll, pitch, target);
+
+    typename Kinematics::Candidates candidates;
+    Kinematics::computeAllPossibleSolutions(target, candidates);
+
+    auto best_distance = std::numeric_limits<Scalar>::infinity();
+    for (const auto& candidate : candidates)
+    {
+      auto is_valid = true;
+      Scalar distance = 0;
+      for (auto j = 0; j < JOINT_NUM; ++j)
+      {
+        // NaN fails both comparisons
+        is_valid &= candidate[j] >= lower_limits[j] && candidate[j] <= upper_limits[j];
+        distance += (candidate[j] - sample.joint_values[j]) * (candidate[j] - sample.joint_values[j]);
+      }
+      if (is_valid && distance < best_distance && Kinematics::isSolutionExact(candidate, target, tolerance))
+      {
+        best_distance = distance;
+        solutions[i] = candidate;
+      }
+    }
+    found[i] = best_distance < std::numeric_limits<Scalar>::infinity();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  Result result{};
+  result.solve_ns = std::chrono::duration<double, std::nano>(end - start).count() / samples.size();
+  for (std::size_t i = 0; i < samples.size(); ++i)
+  {
+    if (!found[i])
+    {
+      continue;
+    }
+
+    Reference::JointValues joint_values;
+    std::copy(solutions[i].cbegin(), solutions[i].cend(), joint_values.begin());
+    std::array<double, 3> position;
+    std::array<double, 4> orientation;
+    Reference::computeToolPose(joint_values.data(), position, orientation);
+
+    const auto error = std::sqrt((position[0] - samples[i].position[0]) * (position[0] - samples[i].position[0]) +
+                                 (position[1] - samples[i].position[1]) * (position[1] - samples[i].position[1]) +
+                                 (position[2] - samples[i].position[2]) * (position[2] - samples[i].position[2]));
+    result.max_position_error = std::max(result.max_position_error, error);
+    result.mean_position_error += error;
+    result.checksum += joint_values[0];
+    ++result.solved_num;
+  }
+  result.mean_position_error /= std::max(result.solved_num, 1);
+  return result;
+}
+
+void print(const char* name, const Result& result)
+{
+  std::printf("  %-6s %8.1f ns, %d solved, position error mean %.3g m max %.3g m (checksum %g)\n", name,
+              result.solve_ns, result.solved_num, result.mean_position_error, result.max_position_error,
+              result.checksum);
+}
+}  // namespace
+
+// Latency and accuracy of the float and the double kernels over the tool poses of random joint values
+int main()
+{
+  std::mt19937 generator(0);
+  std::vector<Sample> samples(sample_num);
+  for (auto& sample : samples)
+  {
+    for (auto i = 0; i < JOINT_NUM; ++i)
+    {
+      sample.joint_values[i] = std::uniform_real_distribution<double>(lower_limits[i], upper_limits[i])(generator);
+    }
+    Reference::computeToolPose(sample.joint_values.data(), sample.position, sample.orientation);
+  }
+
+  std::printf("IK of the tool pose over %d samples:\n", sample_num);
+  print("double", run<double>(samples, 1e-6));
+  print("float", run<float>(samples, 1e-3f));
+  return 0;
+}
@@ -1,16 +1,129 @@
 #include "xarm_kinematics_plugin/xarm_kinematics_plugin.h"
 
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <moveit/robot_model/robot_model.h>
 #include <pluginlib/class_list_macros.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "xarm_kinematics_plugin/simd_math.h"
+#include "xarm_kinematics_plugin/xarm_geometry.h"
 
 namespace xarm_kinematics_plugin
 {
+namespace
+{
+// Link lengths generated from xarm.urdf for the FK of all links, see cmake/xarm_geometry.cmake
+using geometry::a1;
+using geometry::a2;
+using geometry::a3;
+using geometry::base_height;
+using geometry::flange_length;
+using geometry::joint1_height;
+using geometry::wrist_length;
+
+// Largest difference between the joint origins of the robot model and the generated constants in meters
+constexpr double geometry_tolerance = 1e-6;
+
+// Largest error of the wrist position in meters and of the tool axes for a candidate to reach the target
+constexpr double solution_tolerance = 1e-6;
+
+// Largest angle in radians between the target orientation and the nearest reachable one for an exact solution
+constexpr double orientation_tolerance = 1e-6;
+
+// Largest difference of every joint in radians for two solutions to be the same
+constexpr double duplicate_tolerance = 1e-6;
+
+// Largest difference of every joint in radians for a closed-form solution to be the differential one. The differential
+// IK stops within the solution tolerance, a few times duplicate_tolerance away near singularities.
+constexpr double differential_duplicate_tolerance = 1e-4;
+
+// Newton steps of the differential IK, it converges in 2 or 3 steps from 5 mm away
+constexpr int differential_iteration_num = 6;
+
+// Smallest pivot of the Jacobian, smaller ones are singular, e.g. the stretched elbow or the tool on the Z axis
+constexpr double jacobian_min_pivot = 1e-6;
+
+// Initial damping of the refinement, it converges in 2 or 3 iterations from the residuals of the closed-form solution
+constexpr double refinement_damping = 1e-3;
+
+// Error of the refinement to stop at, well within the solution tolerance
+constexpr double refinement_tolerance = solution_tolerance * 1e-2;
+
+#ifdef XARM_KINEMATICS_STATISTICS
+// Records the latency, the result and the branch of the solution of a call when it returns
+class CallRecorder
+{
+public:
+  CallRecorder(IkStatistics& statistics, const moveit_msgs::MoveItErrorCodes& error_code,
+               const std::vector<double>& solution)
+    : statistics_(statistics), error_code_(error_code), solution_(solution), start_(std::chrono::steady_clock::now())
+  {
+  }
+
+  ~CallRecorder()
+  {
+    const auto latency = std::chrono::steady_clock::now() - start_;
+    statistics_.recordCall(getResult(), getBranch(),
+                           std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  }
+
+private:
+  typedef XarmKinematicsPlugin::Kinematics Kinematics;
+
+  IkStatistics& statistics_;
+  const moveit_msgs::MoveItErrorCodes& error_code_;
+  const std::vector<double>& solution_;
+  const std::chrono::steady_clock::time_point start_;
+
+  IkStatistics::Result getResult() const
+  {
+    switch (error_code_.val)
+    {
+      case moveit_msgs::MoveItErrorCodes::SUCCESS:
+        return IkStatistics::SUCCESS;
+      case moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION:
+        return IkStatistics::NO_SOLUTION;
+      case moveit_msgs::MoveItErrorCodes::TIMED_OUT:
+        return IkStatistics::TIMED_OUT;
+      default:
+        return IkStatistics::OTHER_ERROR;
+    }
+  }
+
+  // The wrist is reached over the Z axis if its distance along the direction of theta1 is negative
+  IkStatistics::Branch getBranch() const
+  {
+    if (error_code_.val != moveit_msgs::MoveItErrorCodes::SUCCESS || solution_.size() != JOINT_NUM)
+    {
+      return IkStatistics::NO_BRANCH;
+    }
+
+    const auto is_over = Kinematics::a1 + Kinematics::a2 * std::sin(solution_[1]) +
+                             Kinematics::a3 * std::sin(solution_[1] + solution_[2]) <
+                         0;
+    const auto is_elbow_negative = solution_[2] < 0;
+    return static_cast<IkStatistics::Branch>((is_over ? IkStatistics::OVER_ELBOW_POSITIVE : 0) +
+                                             (is_elbow_negative ? 1 : 0));
+  }
+};
+#endif
+}  // namespace
+
 XarmKinematicsPlugin::XarmKinematicsPlugin()
+  : differential_ik_(false)
+  , differential_ik_max_step_(0.02)
+  , ik_refinement_(false)
+  , ik_refinement_max_residual_(1e-2)
+  , ik_refinement_max_iterations_(10)
+  , trajectory_max_joint_step_(0.5)
 {
   joint_names_.reserve(JOINT_NUM);
   link_names_.reserve(JOINT_NUM);
   lower_limits_.reserve(JOINT_NUM);
   upper_limits_.reserve(JOINT_NUM);
+  resetRefinementStatistics();
 }
 
 XarmKinematicsPlugin::~XarmKinematicsPlugin()
@@ -21,7 +134,107 @@ bool XarmKinematicsPlugin::getPositionFK(const std::vector<std::string>& link_na
                                          const std::vector<double>& joint_angles,
                                          std::vector<geometry_msgs::Pose>& poses) const
 {
-  return false;
+  if (joint_angles.size() != JOINT_NUM)
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_plugin", "Expected %d joint angles, got %zu", JOINT_NUM, joint_angles.size());
+    return false;
+  }
+
+  std::array<geometry_msgs::Pose, LINK_NUM> link_poses;
+  computeFk(joint_angles.data(), link_poses);
+
+  poses.resize(link_names.size());
+  for (std::size_t i = 0; i < link_names.size(); ++i)
+  {
+    const auto index = getLinkIndex(link_names[i]);
+    if (index < 0)
+    {
+      ROS_ERROR_NAMED("xarm_kinematics_plugin", "Cannot compute FK for link %s", link_names[i].c_str());
+      return false;
+    }
+    poses[i] = link_poses[index];
+  }
+
+  return true;
+}
+
+void XarmKinematicsPlugin::computeFk(const double* joint_angles,
+                                     std::array<geometry_msgs::Pose, LINK_NUM>& link_poses) const
+{
+  // Joints 2 ~ 4 rotate about parallel Y axes, so every link frame is Rz(theta1) * Ry(phi) [* Rz(theta5)] where phi is
+  // the accumulated pitch. Positions are computed in the arm plane (radius r, height z) and then rotated by theta1.
+  const auto s1 = sin(joint_angles[0]);
+  const auto c1 = cos(joint_angles[0]);
+  const auto hs1 = sin(joint_angles[0] / 2);
+  const auto hc1 = cos(joint_angles[0] / 2);
+  const auto hs5 = sin(joint_angles[4] / 2);
+  const auto hc5 = cos(joint_angles[4] / 2);
+
+  auto set_pose = [&](geometry_msgs::Pose& pose, double r, double z, double phi, bool with_theta5) {
+    pose.position.x = r * c1;
+    pose.position.y = r * s1;
+    pose.position.z = z;
+
+    // Quaternion of Rz(theta1) * Ry(phi)
+    const auto hs = sin(phi / 2);
+    const auto hc = cos(phi / 2);
+    const auto w = hc1 * hc;
+    const auto x = -hs1 * hs;
+    const auto y = hc1 * hs;
+    const auto qz = hs1 * hc;
+    if (with_theta5)
+    {
+      // Post-multiplied by Rz(theta5)
+      pose.orientation.w = w * hc5 - qz * hs5;
+      pose.orientation.x = x * hc5 + y * hs5;
+      pose.orientation.y = y * hc5 - x * hs5;
+      pose.orientation.z = w * hs5 + qz * hc5;
+    }
+    else
+    {
+      pose.orientation.w = w;
+      pose.orientation.x = x;
+      pose.orientation.y = y;
+      pose.orientation.z = qz;
+    }
+  };
+
+  // base_link
+  link_poses[0] = geometry_msgs::Pose();
+  link_poses[0].orientation.w = 1;
+
+  // arm_link1
+  set_pose(link_poses[1], 0, joint1_height, 0, false);
+
+  // arm_link2
+  auto phi = joint_angles[1];
+  auto r = a1;
+  auto z = base_height;
+  set_pose(link_poses[2], r, z, phi, false);
+
+  // arm_link3
+  r += a2 * sin(phi);
+  z += a2 * cos(phi);
+  phi += joint_angles[2];
+  set_pose(link_poses[3], r, z, phi, false);
+
+  // arm_link4
+  r += a3 * sin(phi);
+  z += a3 * cos(phi);
+  phi += joint_angles[3];
+  set_pose(link_poses[4], r, z, phi, false);
+
+  // arm_link5
+  const auto sp = sin(phi);
+  const auto cp = cos(phi);
+  r += wrist_length * sp;
+  z += wrist_length * cp;
+  set_pose(link_poses[5], r, z, phi, true);
+
+  // Tip link
+  r += flange_length * sp;
+  z += flange_length * cp;
+  set_pose(link_poses[6], r, z, phi, true);
 }
 
 bool XarmKinematicsPlugin::getPositionIK(const geometry_msgs::Pose& ik_pose, const std::vector<double>& ik_seed_state,
@@ -35,15 +248,117 @@ bool XarmKinematicsPlugin::getPositionIK(const geometry_msgs::Pose& ik_pose, con
                           error_code, options);
 }
 
+bool XarmKinematicsPlugin::getPositionIK(const std::vector<geometry_msgs::Pose>& ik_poses,
+                                         const std::vector<double>& ik_seed_state,
+                                         std::vector<std::vector<double>>& solutions,
+                                         kinematics::KinematicsResult& result,
+                                         const kinematics::KinematicsQueryOptions& options) const
+{
+  solutions.clear();
+  result.solution_percentage = 0;
+
+  if (ik_poses.empty())
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_plugin", "The list of poses is empty");
+    result.kinematic_error = kinematics::KinematicErrors::EMPTY_TIP_POSES;
+    return false;
+  }
+
+  if (ik_poses.size() > 1)
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_plugin", "Only one pose is supported");
+    result.kinematic_error = kinematics::KinematicErrors::MULTIPLE_TIPS_NOT_SUPPORTED;
+    return false;
+  }
+
+  if (ik_seed_state.size() != JOINT_NUM)
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_plugin", "Seed state must have %d elements", JOINT_NUM);
+    result.kinematic_error = kinematics::KinematicErrors::NO_SOLUTION;
+    return false;
+  }
+
+  geometry_msgs::Pose pose;
+  if (!getSolvablePose(ik_poses[0], options, pose))
+  {
+    result.kinematic_error = kinematics::KinematicErrors::NO_SOLUTION;
+    return false;
+  }
+
+  // There are no redundant joints, so every discretization method gives the same solutions
+  const std::vector<double> consistency_limits;
+  const auto deadline = ros::WallTime::now() + ros::WallDuration(default_timeout_);
+  Candidates sorted_solutions;
+  const auto solution_num = solveIkSortedBySeed(pose, ik_seed_state, consistency_limits, deadline, sorted_solutions);
+  if (solution_num == 0)
+  {
+    result.kinematic_error = kinematics::KinematicErrors::NO_SOLUTION;
+    return false;
+  }
+
+  for (auto i = 0; i < solution_num; ++i)
+  {
+    solutions.emplace_back(sorted_solutions[i].cbegin(), sorted_solutions[i].cend());
+  }
+
+  result.kinematic_error = kinematics::KinematicErrors::OK;
+  result.solution_percentage = 1.0;
+  return true;
+}
+
 bool XarmKinematicsPlugin::initialize(const moveit::core::RobotModel& robot_model, const std::string& group_name,
                                       const std::string& base_frame, const std::vector<std::string>& tip_frames,
                                       double search_discretization)
 {
   setValues(robot_model.getName(), group_name, base_frame, tip_frames, search_discretization);
 
+  // Reloads the chain and the limits, the cached solutions of the previous ones are dropped below
+  link_names_.clear();
+  joint_names_.clear();
+  lower_limits_.clear();
+  upper_limits_.clear();
+
+  // Joint origins of base_link, arm_link1 ~ arm_link5 and the tip link that the kernels are generated for
+  const std::array<std::array<double, 3>, LINK_NUM> expected_origins{ { { { 0, 0, 0 } },
+                                                                      { { 0, 0, joint1_height } },
+                                                                      { { a1, 0, geometry::joint2_height } },
+                                                                      { { 0, 0, a2 } },
+                                                                      { { 0, 0, a3 } },
+                                                                      { { 0, 0, wrist_length } },
+                                                                      { { 0, 0, flange_length } } } };
+  const auto is_origin_expected = [&](const moveit::core::LinkModel* link, std::size_t index) {
+    if (index >= expected_origins.size())
+    {
+      return false;
+    }
+    const auto origin = link->getJointOriginTransform().translation();
+    for (auto i = 0; i < 3; ++i)
+    {
+      if (std::abs(origin[i] - expected_origins[index][i]) > geometry_tolerance)
+      {
+        return false;
+      }
+    }
+    return true;
+  };
+
   auto link_models = robot_model.getLinkModels();
   for (const auto& link : link_models)
   {
+    // Skip the links above the base frame, e.g. dummy_base of xarm.urdf.xacro
+    if (link_names_.empty() && link->getName() != base_frame_)
+    {
+      continue;
+    }
+
+    if (!is_origin_expected(link, link_names_.size()))
+    {
+      ROS_ERROR_NAMED("xarm_kinematics_plugin", "The joint origin of %s does not match xarm_geometry.h, rebuild with "
+                                                "the URDF of the robot model",
+                      link->getName().c_str());
+      return false;
+    }
+
     if (link->getName() == tip_frames_.at(0))
     {
       break;
@@ -74,6 +389,74 @@ bool XarmKinematicsPlugin::initialize(const moveit::core::RobotModel& robot_mode
     }
   }
 
+  lookupParam("joint_weights", joint_weights_, std::vector<double>(JOINT_NUM, 1.0));
+  if (joint_weights_.size() != JOINT_NUM)
+  {
+    ROS_WARN_NAMED("xarm_kinematics_plugin", "joint_weights must have %d elements, using equal weights", JOINT_NUM);
+    joint_weights_.assign(JOINT_NUM, 1.0);
+  }
+
+  // Solutions of a pose are reused for every pose in the same cell, so the resolutions bound the error of a hit
+  int ik_cache_size;
+  double ik_cache_position_resolution, ik_cache_orientation_resolution;
+  lookupParam("ik_cache_size", ik_cache_size, 0);
+  lookupParam("ik_cache_position_resolution", ik_cache_position_resolution, 1e-4);
+  lookupParam("ik_cache_orientation_resolution", ik_cache_orientation_resolution, 1e-4);
+  if (ik_cache_size > 0 && (ik_cache_position_resolution <= 0 || ik_cache_orientation_resolution <= 0))
+  {
+    ROS_WARN_NAMED("xarm_kinematics_plugin", "IK cache resolutions must be positive, disabling the IK cache");
+    ik_cache_size = 0;
+  }
+
+  if (ik_cache_size > 0)
+  {
+    ik_cache_.reset(
+        new IkCache<ExactSolutions>(ik_cache_size, ik_cache_position_resolution, ik_cache_orientation_resolution));
+  }
+  else
+  {
+    ik_cache_.reset();
+  }
+
+  lookupParam("differential_ik", differential_ik_, false);
+  lookupParam("differential_ik_max_step", differential_ik_max_step_, 0.02);
+
+  lookupParam("ik_refinement", ik_refinement_, false);
+  lookupParam("ik_refinement_max_residual", ik_refinement_max_residual_, 1e-2);
+  lookupParam("ik_refinement_max_iterations", ik_refinement_max_iterations_, 10);
+  resetRefinementStatistics();
+
+  lookupParam("trajectory_max_joint_step", trajectory_max_joint_step_, 0.5);
+
+#ifdef XARM_KINEMATICS_STATISTICS
+  ik_statistics_.reset(new IkStatistics);
+  double ik_statistics_period;
+  lookupParam("ik_statistics_period", ik_statistics_period, 10.0);
+  if (ik_statistics_period > 0)
+  {
+    ros::NodeHandle node_handle;
+    diagnostics_publisher_ = node_handle.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    diagnostics_timer_ = node_handle.createWallTimer(ros::WallDuration(ik_statistics_period),
+                                                     [this](const ros::WallTimerEvent&) { publishIkStatistics(); });
+  }
+  else
+  {
+    diagnostics_timer_.stop();
+  }
+#endif
+
+  std::string reachability_map;
+  lookupParam("reachability_map", reachability_map, std::string());
+  if (reachability_map.empty())
+  {
+    reachability_map_.unload();
+  }
+  else if (!reachability_map_.load(reachability_map))
+  {
+    ROS_WARN_NAMED("xarm_kinematics_plugin", "Failed to load the reachability map %s, solving every pose",
+                   reachability_map.c_str());
+  }
+
   return true;
 }
 
@@ -120,53 +503,388 @@ bool XarmKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose,
                                             moveit_msgs::MoveItErrorCodes& error_code,
                                             const kinematics::KinematicsQueryOptions& options) const
 {
-  // auto pose = ik_pose;  // Make a copy of the pose
-  // if (!isPoseReachable(pose) && !revisePose(pose))
-  // {
-  //   ROS_ERROR_NAMED("xarm_kinematics_plugin", "The target pose is not reachable");
-  //   return false;
-  // }
+#ifdef XARM_KINEMATICS_STATISTICS
+  const CallRecorder call_recorder(*ik_statistics_, error_code, solution);
+#endif
+
+  if (ik_seed_state.size() != JOINT_NUM)
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_plugin", "Seed state must have %d elements", JOINT_NUM);
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
 
-  // tf::Quaternion q(pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w);
-  // tf::Matrix3x3 rotation_matrix(q);
-  if (!solveIkFromAllPossibleSolutions(ik_pose, solution))
+  if (!consistency_limits.empty() && consistency_limits.size() != JOINT_NUM)
   {
+    ROS_ERROR_NAMED("xarm_kinematics_plugin", "Consistency limits must be empty or have %d elements", JOINT_NUM);
     error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
     return false;
   }
 
-  error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  const auto deadline = ros::WallTime::now() + ros::WallDuration(timeout);
+
+  geometry_msgs::Pose pose;
+  if (!getSolvablePose(ik_pose, options, pose))
+  {
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  // Small steps, e.g. of a Cartesian path, continue from the seed state without flipping the branch
+  JointValues differential_solution;
+  auto is_differential_rejected = false;
+  if (differential_ik_ && solveIkDifferential(pose, ik_seed_state, consistency_limits, differential_solution))
+  {
+    solution.assign(differential_solution.cbegin(), differential_solution.cend());
+    if (!solution_callback)
+    {
+      error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+      return true;
+    }
+
+    solution_callback(ik_pose, solution, error_code);
+    if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
+    {
+      return true;
+    }
+    is_differential_rejected = true;
+  }
+
+  Candidates solutions;
+  const auto solution_num = solveIkSortedBySeed(pose, ik_seed_state, consistency_limits, deadline, solutions);
+  if (solution_num == 0)
+  {
+    ROS_DEBUG_NAMED("xarm_kinematics_plugin", "No IK solution, the pose is %s",
+                    Kinematics::getSingularityName(classifyPose(pose)));
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  // Reuses the memory of solution
+  if (!solution_callback)
+  {
+    solution.assign(solutions[0].cbegin(), solutions[0].cend());
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return true;
+  }
+
+  // The closed-form solution on the branch of the seed state is the differential one, which the callback rejected
+  const auto is_rejected = [&](const JointValues& candidate) {
+    return is_differential_rejected &&
+           std::equal(candidate.cbegin(), candidate.cend(), differential_solution.cbegin(),
+                      [](double a, double b) { return std::abs(a - b) < differential_duplicate_tolerance; });
+  };
+
+  // Offer the solutions from the closest one until the callback accepts one, e.g. the first one without collision
+  for (auto i = 0; i < solution_num; ++i)
+  {
+    if (ros::WallTime::now() > deadline)
+    {
+      error_code.val = moveit_msgs::MoveItErrorCodes::TIMED_OUT;
+      return false;
+    }
+
+    if (is_rejected(solutions[i]))
+    {
+      continue;
+    }
+
+    solution.assign(solutions[i].cbegin(), solutions[i].cend());
+    solution_callback(ik_pose, solution, error_code);
+    if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
+    {
+      return true;
+    }
+  }
+
+  error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+  return false;
+}
+
+double XarmKinematicsPlugin::projectPose(const geometry_msgs::Pose& pose, geometry_msgs::Pose& projected_pose) const
+{
+  double roll, pitch, yaw;
+  quaternionToRpy(pose.orientation, roll, pitch, yaw);
+
+  const auto azimuth = atan2(pose.position.y, pose.position.x);
+  double projected_roll, projected_pitch;
+  const auto deviation =
+      Kinematics::projectOrientation(azimuth, roll, pitch, yaw, projected_roll, projected_pitch);
+
+  projected_pose.position = pose.position;
+  rpyToQuaternion(projected_roll, projected_pitch, azimuth, projected_pose.orientation);
+  return deviation;
+}
+
+XarmKinematicsPlugin::Kinematics::Singularity XarmKinematicsPlugin::classifyPose(const geometry_msgs::Pose& pose) const
+{
+  IkTarget target;
+  computeIkTarget(pose, target);
+  return Kinematics::classifyTarget(target);
+}
+
+bool XarmKinematicsPlugin::getIkCacheStatistics(std::uint64_t& hit_num, std::uint64_t& miss_num) const
+{
+  if (!ik_cache_)
+  {
+    return false;
+  }
+
+  hit_num = ik_cache_->getHitNum();
+  miss_num = ik_cache_->getMissNum();
   return true;
 }
 
-bool XarmKinematicsPlugin::isPoseReachable(const geometry_msgs::Pose& pose) const
+bool XarmKinematicsPlugin::getRefinementStatistics(RefinementStatistics& statistics) const
 {
-  if (pose.position.z < 0)
+  if (!ik_refinement_)
+  {
+    return false;
+  }
+
+  statistics = RefinementStatistics();
+  refinement_counters_.forEach([&](const RefinementCounters& counters) {
+    statistics.refined_num += counters.refined_num.load(std::memory_order_relaxed);
+    statistics.converged_num += counters.converged_num.load(std::memory_order_relaxed);
+    statistics.timed_out_num += counters.timed_out_num.load(std::memory_order_relaxed);
+    statistics.iteration_num += counters.iteration_num.load(std::memory_order_relaxed);
+    statistics.max_residual = std::max(statistics.max_residual, counters.max_residual.load(std::memory_order_relaxed));
+    for (auto i = 0; i < RESIDUAL_BIN_NUM; ++i)
+    {
+      statistics.residual_histogram[i] += counters.residual_histogram[i].load(std::memory_order_relaxed);
+    }
+  });
+  return true;
+}
+
+bool XarmKinematicsPlugin::getIkStatistics(IkStatistics::Snapshot& snapshot) const
+{
+  if (!ik_statistics_)
+  {
+    return false;
+  }
+
+  ik_statistics_->getSnapshot(snapshot);
+  return true;
+}
+
+bool XarmKinematicsPlugin::solveTrajectory(const std::vector<geometry_msgs::Pose>& poses,
+                                           const std::vector<double>& ik_seed_state, double timeout,
+                                           TrajectorySolution& solution,
+                                           const kinematics::KinematicsQueryOptions& options) const
+{
+  solution.joint_values.assign(poses.size(), std::vector<double>());
+  solution.discontinuities.clear();
+
+  if (ik_seed_state.size() != JOINT_NUM)
   {
+    ROS_ERROR_NAMED("xarm_kinematics_plugin", "Seed state must have %d elements", JOINT_NUM);
     return false;
   }
 
+  const auto deadline = ros::WallTime::now() + ros::WallDuration(timeout);
+  JointValues seed;
+  std::copy(ik_seed_state.cbegin(), ik_seed_state.cend(), seed.begin());
+
+  // Shortest path through the solutions of all poses: the least joint motion from the seed state to every solution,
+  // the solution of the previous pose with solutions that it comes from, and that pose. Poses without solutions are
+  // skipped.
+  std::vector<ExactSolutions> layers(poses.size());
+  std::vector<std::array<double, CANDIDATE_NUM>> costs(poses.size());
+  std::vector<std::array<int, CANDIDATE_NUM>> predecessors(poses.size());
+  std::vector<int> previous_layers(poses.size(), -1);
+  auto previous = -1;
+  for (std::size_t i = 0; i < poses.size(); ++i)
+  {
+    auto& layer = layers[i];
+    geometry_msgs::Pose pose;
+    if (getSolvablePose(poses[i], options, pose))
+    {
+      findExactSolutions(pose, ik_seed_state[0], deadline, layer);
+    }
+    else
+    {
+      layer.solution_num = 0;
+    }
+
+    if (layer.solution_num == 0)
+    {
+      solution.discontinuities.push_back(i);
+      continue;
+    }
+
+    for (auto k = 0; k < layer.solution_num; ++k)
+    {
+      if (previous < 0)
+      {
+        costs[i][k] = getJointDistance(layer.solutions[k], seed);
+        continue;
+      }
+
+      costs[i][k] = std::numeric_limits<double>::infinity();
+      for (auto j = 0; j < layers[previous].solution_num; ++j)
+      {
+        const auto cost = costs[previous][j] + getJointDistance(layers[previous].solutions[j], layer.solutions[k]);
+        if (cost < costs[i][k])
+        {
+          costs[i][k] = cost;
+          predecessors[i][k] = j;
+        }
+      }
+    }
+    previous_layers[i] = previous;
+    previous = i;
+  }
+
+  if (previous < 0)
+  {
+    return false;
+  }
+
+  const auto is_jump = [this](const JointValues& a, const JointValues& b) {
+    for (auto j = 0; j < JOINT_NUM; ++j)
+    {
+      if (std::abs(a[j] - b[j]) > trajectory_max_joint_step_)
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Back from the cheapest solution of the last pose with solutions, the first one is reached from the seed state
+  const auto& last_costs = costs[previous];
+  auto k = static_cast<int>(std::min_element(last_costs.cbegin(), last_costs.cbegin() + layers[previous].solution_num) -
+                            last_costs.cbegin());
+  for (auto i = previous; i >= 0; i = previous_layers[i])
+  {
+    const auto& joint_values = layers[i].solutions[k];
+    solution.joint_values[i].assign(joint_values.cbegin(), joint_values.cend());
+
+    const auto previous_layer = previous_layers[i];
+    if (previous_layer >= 0)
+    {
+      k = predecessors[i][k];
+    }
+    if (is_jump(joint_values, previous_layer >= 0 ? layers[previous_layer].solutions[k] : seed))
+    {
+      solution.discontinuities.push_back(i);
+    }
+  }
+
+  std::sort(solution.discontinuities.begin(), solution.discontinuities.end());
+  return solution.discontinuities.empty();
+}
+
+void XarmKinematicsPlugin::computeToolPose(const double* joint_angles, geometry_msgs::Pose& pose) const
+{
+  std::array<double, 3> position;
+  std::array<double, 4> orientation;
+  Kinematics::computeToolPose(joint_angles, position, orientation);
+  pose.position.x = position[0];
+  pose.position.y = position[1];
+  pose.position.z = position[2];
+  pose.orientation.x = orientation[0];
+  pose.orientation.y = orientation[1];
+  pose.orientation.z = orientation[2];
+  pose.orientation.w = orientation[3];
+}
+
+void XarmKinematicsPlugin::computeJacobian(const double* joint_angles, Jacobian& jacobian) const
+{
+  std::array<double, 3> position;
+  Kinematics::computeToolPositionAndJacobian(joint_angles, position, jacobian);
+}
+
+bool XarmKinematicsPlugin::getSolvablePose(const geometry_msgs::Pose& ik_pose,
+                                           const kinematics::KinematicsQueryOptions& options,
+                                           geometry_msgs::Pose& pose) const
+{
   double roll, pitch, yaw;
-  quaternionToRpy(pose.orientation, roll, pitch, yaw);
+  quaternionToRpy(ik_pose.orientation, roll, pitch, yaw);
 
-  if (pose.position.x == 0 && abs(sin(yaw)) > 0.99)
+  // On the Z axis the position leaves the plane of the arm free, the tool axis sets it
+  const auto azimuth = (std::hypot(ik_pose.position.x, ik_pose.position.y) < Kinematics::singular_tolerance) ?
+                           yaw :
+                           atan2(ik_pose.position.y, ik_pose.position.x);
+  double projected_roll, projected_pitch;
+  const auto deviation =
+      Kinematics::projectOrientation(azimuth, roll, pitch, yaw, projected_roll, projected_pitch);
+  if (deviation <= orientation_tolerance)
   {
+    pose = ik_pose;  // The projection only differs by rounding
     return true;
   }
 
-  constexpr double threshold = 0.01;
-  auto y = pose.position.x * tan(yaw);
-  if (y - threshold <= pose.position.y && pose.position.y <= y + threshold)
+  if (!options.return_approximate_solution)
   {
-    return true;
+    ROS_DEBUG_NAMED("xarm_kinematics_plugin", "The orientation is %g rad from the nearest reachable one", deviation);
+    return false;
   }
 
-  return false;
+  ROS_DEBUG_NAMED("xarm_kinematics_plugin", "Solving the nearest reachable orientation, %g rad from the target",
+                  deviation);
+  pose.position = ik_pose.position;
+  rpyToQuaternion(projected_roll, projected_pitch, azimuth, pose.orientation);
+  return true;
+}
+
+int XarmKinematicsPlugin::getLinkIndex(const std::string& link_name) const
+{
+  for (std::size_t i = 0; i < link_names_.size(); ++i)
+  {
+    if (link_names_[i] == link_name)
+    {
+      return static_cast<int>(i);
+    }
+  }
+
+  if (!tip_frames_.empty() && tip_frames_[0] == link_name)
+  {
+    return LINK_NUM - 1;
+  }
+
+  return -1;
+}
+
+double XarmKinematicsPlugin::getJointDistance(const JointValues& a, const JointValues& b) const
+{
+  double distance = 0;
+  for (auto i = 0; i < JOINT_NUM; ++i)
+  {
+    distance += joint_weights_[i] * (a[i] - b[i]) * (a[i] - b[i]);
+  }
+  return distance;
 }
 
-bool XarmKinematicsPlugin::isSolutionValid(const std::vector<double>& solution) const
+double XarmKinematicsPlugin::getSeedDistance(const JointValues& solution,
+                                             const std::vector<double>& ik_seed_state) const
 {
-  for (auto i = 0; i < solution.size(); ++i)
+  double distance = 0;
+  for (auto i = 0; i < JOINT_NUM; ++i)
+  {
+    distance += joint_weights_[i] * (solution[i] - ik_seed_state[i]) * (solution[i] - ik_seed_state[i]);
+  }
+  return distance;
+}
+
+bool XarmKinematicsPlugin::isSolutionConsistent(const JointValues& solution,
+                                                const std::vector<double>& ik_seed_state,
+                                                const std::vector<double>& consistency_limits) const
+{
+  for (std::size_t i = 0; i < consistency_limits.size(); ++i)
+  {
+    if (std::abs(solution[i] - ik_seed_state[i]) > consistency_limits[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool XarmKinematicsPlugin::isSolutionValid(const JointValues& solution) const
+{
+  for (auto i = 0; i < JOINT_NUM; ++i)
   {
     if (std::isnan(solution[i]) || solution[i] < lower_limits_[i] || solution[i] > upper_limits_[i])
     {
@@ -178,535 +896,469 @@ bool XarmKinematicsPlugin::isSolutionValid(const std::vector<double>& solution)
 
 void XarmKinematicsPlugin::quaternionToRpy(const geometry_msgs::Quaternion& q, double& roll, double& pitch,
                                            double& yaw) const
-{  // Roll, X axis
-  roll = atan2(2 * (q.y * q.z + q.w * q.x), q.w * q.w - q.x * q.x - q.y * q.y + q.z * q.z);
-  // Pitch, Y axis
-  pitch = asin(-2 * (q.x * q.z - q.w * q.y));
-  // Yaw, Z axis
-  yaw = atan2(2 * (q.x * q.y + q.w * q.z), q.w * q.w + q.x * q.x - q.y * q.y - q.z * q.z);
+{
+  Kinematics::quaternionToRpy(q.x, q.y, q.z, q.w, roll, pitch, yaw);
+}
+
+void XarmKinematicsPlugin::rpyToQuaternion(double roll, double pitch, double yaw, geometry_msgs::Quaternion& q) const
+{
+  Kinematics::rpyToQuaternion(roll, pitch, yaw, q.x, q.y, q.z, q.w);
 }
 
-bool XarmKinematicsPlugin::revisePose(geometry_msgs::Pose& pose) const
+void XarmKinematicsPlugin::computeIkTarget(const geometry_msgs::Pose& ik_pose, IkTarget& target) const
 {
   double roll, pitch, yaw;
-  quaternionToRpy(pose.orientation, roll, pitch, yaw);
+  quaternionToRpy(ik_pose.orientation, roll, pitch, yaw);
+
+  // The RPY angles of a pose reaching over the Z axis have the yaw of the azimuth + pi, the projection turns them into
+  // a pitch beyond pi / 2 at the azimuth
+  const auto azimuth = atan2(ik_pose.position.y, ik_pose.position.x);
+  Kinematics::projectOrientation(azimuth, roll, pitch, yaw, roll, pitch);
+  Kinematics::computeTarget(ik_pose.position.x, ik_pose.position.y, ik_pose.position.z, roll, pitch, target);
+}
+
+void XarmKinematicsPlugin::publishIkStatistics() const
+{
+  IkStatistics::Snapshot snapshot;
+  if (!getIkStatistics(snapshot))
+  {
+    return;
+  }
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.resize(1);
+  IkStatistics::toDiagnosticStatus(snapshot, diagnostics.status[0]);
+  diagnostics.status[0].name = "xarm_kinematics_plugin: " + group_name_;
+  diagnostics.status[0].hardware_id = group_name_;
+  diagnostics_publisher_.publish(diagnostics);
+}
+
+bool XarmKinematicsPlugin::refineSolution(JointValues& solution, const IkTarget& target,
+                                          const ros::WallTime& deadline, bool& is_timed_out) const
+{
+  is_timed_out = false;
+  // Farther candidates are on other branches of the closed-form solution, most fail on the wrist position already
+  if (!Kinematics::isSolutionExact(solution, target, ik_refinement_max_residual_))
+  {
+    return false;
+  }
 
-  if (pose.position.x != 0)
+  Kinematics::Residual residual;
+  Kinematics::computeResidual(solution, target, residual, nullptr);
+  auto max_error = std::abs(*std::max_element(residual.cbegin(), residual.cend(), [](double a, double b) {
+    return std::abs(a) < std::abs(b);
+  }));
+
+  auto& counters = refinement_counters_.get();
+  counters.refined_num.fetch_add(1, std::memory_order_relaxed);
+  auto bin = 0;
+  for (auto bound = solution_tolerance * 10; max_error >= bound && bin < RESIDUAL_BIN_NUM - 1; bound *= 10)
   {
-    yaw = atan2(pose.position.y, pose.position.x);
-    pose.orientation = tf::createQuaternionMsgFromRollPitchYaw(roll, pitch, yaw);
+    ++bin;
   }
-  else if (pose.position.y > 0)
+  counters.residual_histogram[bin].fetch_add(1, std::memory_order_relaxed);
+
+  auto damping = refinement_damping;
+  auto iteration_num = 0;
+  while (max_error > refinement_tolerance && iteration_num < ik_refinement_max_iterations_)
   {
-    pose.orientation = tf::createQuaternionMsgFromRollPitchYaw(roll, pitch, M_PI / 2);
+    if (ros::WallTime::now() > deadline)
+    {
+      is_timed_out = true;
+      break;
+    }
+    max_error = Kinematics::refineSolution(solution, target, damping);
+    ++iteration_num;
+  }
+  counters.iteration_num.fetch_add(iteration_num, std::memory_order_relaxed);
+
+  if (max_error > solution_tolerance)
+  {
+    if (is_timed_out)
+    {
+      counters.timed_out_num.fetch_add(1, std::memory_order_relaxed);
+    }
+    return false;
   }
-  else if (pose.position.y < 0)
+
+  counters.converged_num.fetch_add(1, std::memory_order_relaxed);
+  // Only this thread writes its block
+  if (max_error > counters.max_residual.load(std::memory_order_relaxed))
   {
-    pose.orientation = tf::createQuaternionMsgFromRollPitchYaw(roll, pitch, -M_PI / 2);
+    counters.max_residual.store(max_error, std::memory_order_relaxed);
   }
+  return true;
+}
 
-  return isPoseReachable(pose);
+void XarmKinematicsPlugin::resetRefinementStatistics()
+{
+  refinement_counters_.forEach([](RefinementCounters& counters) {
+    counters.refined_num = 0;
+    counters.converged_num = 0;
+    counters.timed_out_num = 0;
+    counters.iteration_num = 0;
+    counters.max_residual = 0;
+    for (auto& count : counters.residual_histogram)
+    {
+      count = 0;
+    }
+  });
 }
 
-bool XarmKinematicsPlugin::solveIk(const geometry_msgs::Pose& ik_pose, std::vector<double>& solution) const
+int XarmKinematicsPlugin::solveIkExact(const geometry_msgs::Pose& ik_pose, double free_theta1,
+                                       const ros::WallTime& deadline, Candidates& solutions,
+                                       bool* is_truncated) const
 {
-  const auto p = ik_pose.position;
+  if (is_truncated)
+  {
+    *is_truncated = false;
+  }
 
-  double roll, pitch, yaw;
-  quaternionToRpy(ik_pose.orientation, roll, pitch, yaw);
+  IkTarget target;
+  computeIkTarget(ik_pose, target);
+
+  const auto singularity = Kinematics::classifyTarget(target);
+#ifdef XARM_KINEMATICS_STATISTICS
+  ik_statistics_->recordSingularity(static_cast<int>(singularity));
+#endif
+  if (singularity == Kinematics::Singularity::OUT_OF_REACH)
+  {
+    return 0;
+  }
 
-  // Convert quaternion to rotation matrix
-  tf::Matrix3x3 r;
-  yaw = atan2(p.y, p.x);
-  r.setRPY(roll, pitch, yaw);
+  Candidates all_solutions;
+  const auto candidate_num = Kinematics::computeSolutions(target, singularity, free_theta1, all_solutions);
 
-  // Simplify the rotation matrix
-  for (int i = 0; i < 3; ++i)
+#ifdef XARM_KINEMATICS_STATISTICS
+  std::uint32_t nan_candidates = 0, exact_candidates = 0;
+#endif
+
+  auto solution_num = 0;
+  for (auto i = 0; i < candidate_num; ++i)
   {
-    for (int j = 0; j < 3; ++j)
+    auto& candidate = all_solutions[i];
+
+    // Where theta1 is free arm_joint5 turns with it, theta5 + sign(az) * theta1 is fixed. Trade the part of theta5
+    // beyond its limits for theta1.
+    if (singularity == Kinematics::Singularity::SHOULDER_AND_WRIST)
     {
-      if (abs(r[i][j]) < FLT_EPSILON)
-      {
-        r[i][j] = 0;
-      }
+      const auto theta5 = std::min(std::max(candidate[4], lower_limits_[4]), upper_limits_[4]);
+      candidate[0] -= std::copysign(1.0, target.az) * (theta5 - candidate[4]);
+      candidate[4] = theta5;
+    }
+
+    // Near singularities the rounding of the closed-form solution leaves residuals up to millimeters
+    auto is_timed_out = false;
+    const auto is_solution =
+        isSolutionValid(candidate) &&
+        (Kinematics::isSolutionExact(candidate, target, solution_tolerance) ||
+         (ik_refinement_ && refineSolution(candidate, target, deadline, is_timed_out) && isSolutionValid(candidate)));
+    if (!is_solution && is_timed_out && is_truncated)
+    {
+      *is_truncated = true;
+    }
+
+#ifdef XARM_KINEMATICS_STATISTICS
+    // NaN propagates from theta1 and theta3 to the later joints
+    nan_candidates |= std::isnan(candidate[4]) << i;
+    exact_candidates |= is_solution << i;
+#endif
+
+    if (!is_solution)
+    {
+      continue;
+    }
+
+    const auto is_same = [&](const JointValues& solution) {
+      return std::equal(solution.cbegin(), solution.cend(), candidate.cbegin(),
+                        [](double a, double b) { return std::abs(a - b) < duplicate_tolerance; });
+    };
+    if (std::none_of(solutions.cbegin(), solutions.cbegin() + solution_num, is_same))
+    {
+      solutions[solution_num++] = candidate;
     }
   }
 
-  // Parameters
-  constexpr double a1 = 0.003;
-  constexpr double a2 = 0.096;
-  constexpr double a3 = 0.096;
-  constexpr double base_height = 0.072;  // Height of base relative to world
-  constexpr double tool_length = 0.12;   // Length of terminal tool
-
-  // Transformation from the tool frame to the last frame on the manipulator
-  double nx = r[0][2], ny = r[1][2], nz = r[2][2];
-  double ox = -r[0][1], oy = -r[1][1], oz = -r[2][1];
-  double ax = r[0][0], ay = r[1][0], az = r[2][0];
-  double px = p.x - tool_length * r[0][0];
-  double py = p.y - tool_length * r[1][0];
-  double pz = p.z - tool_length * r[2][0] - base_height;
-
-  // Singular point
-  const auto temp = 2 * a1 * a1 * a2 * a2 - a2 * a2 * a2 * a2 - a3 * a3 * a3 * a3 - px * px * px * px -
-                    py * py * py * py - pz * pz * pz * pz - a1 * a1 * a1 * a1 + 2 * a1 * a1 * a3 * a3 +
-                    2 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * px * px + 2 * a2 * a2 * px * px + 2 * a3 * a3 * px * px +
-                    2 * a1 * a1 * py * py + 2 * a2 * a2 * py * py + 2 * a3 * a3 * py * py - 2 * a1 * a1 * pz * pz +
-                    2 * a2 * a2 * pz * pz + 2 * a3 * a3 * pz * pz - 2 * px * px * py * py - 2 * px * px * pz * pz -
-                    2 * py * py * pz * pz + 8 * a1 * a2 * a3 * sqrt(px * px + py * py);
-  if (temp < 0)
-  {
-    r.setRPY(roll, pitch, 0);
-    r *= tf::Matrix3x3(0, 0, 1, 0, -1, 0, 1, 0, 0);
-    nx = r[0][2], ny = r[1][2], nz = r[2][2];
-    ox = -r[0][1], oy = -r[1][1], oz = -r[2][1];
-    ax = r[0][0], ay = r[1][0], az = r[2][0];
-    px = p.x - tool_length * r[0][0];
-    py = p.y - tool_length * r[1][0];
-    pz = p.z - tool_length * r[2][0] - base_height;
-  }
-
-  // Theta 3
-  std::complex<double> theta3;
-  if (p.y >= 0)
-  {
-    theta3 =
-        2 * atan(sqrt((2 * a1 * a1 * a2 * a2 - a2 * a2 * a2 * a2 - a3 * a3 * a3 * a3 - px * px * px * px -
-                       py * py * py * py - pz * pz * pz * pz - a1 * a1 * a1 * a1 + 2 * a1 * a1 * a3 * a3 +
-                       2 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * px * px + 2 * a2 * a2 * px * px + 2 * a3 * a3 * px * px +
-                       2 * a1 * a1 * py * py + 2 * a2 * a2 * py * py + 2 * a3 * a3 * py * py - 2 * a1 * a1 * pz * pz +
-                       2 * a2 * a2 * pz * pz + 2 * a3 * a3 * pz * pz - 2 * px * px * py * py - 2 * px * px * pz * pz -
-                       2 * py * py * pz * pz + 8 * a1 * a2 * a3 * sqrt(px * px + py * py)) /
-                      ((px * px + py * py) *
-                           (-2 * a1 * a1 - 2 * a2 * a2 + 4 * a2 * a3 - 2 * a3 * a3 + px * px + py * py + 2 * pz * pz) -
-                       4 * a2 * a3 * a3 * a3 - 4 * a2 * a2 * a2 * a3 + a1 * a1 * a1 * a1 + a2 * a2 * a2 * a2 +
-                       a3 * a3 * a3 * a3 + pz * pz * pz * pz - 2 * a1 * a1 * a2 * a2 - 2 * a1 * a1 * a3 * a3 +
-                       6 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * pz * pz - 2 * a2 * a2 * pz * pz - 2 * a3 * a3 * pz * pz +
-                       4 * a1 * a1 * a2 * a3 + 4 * a2 * a3 * pz * pz)));
+#ifdef XARM_KINEMATICS_STATISTICS
+  if (candidate_num == CANDIDATE_NUM)
+  {
+    ik_statistics_->recordCandidates(nan_candidates, exact_candidates);
   }
-  else
+#endif
+
+  return solution_num;
+}
+
+void XarmKinematicsPlugin::findExactSolutions(const geometry_msgs::Pose& ik_pose, double free_theta1,
+                                              const ros::WallTime& deadline, ExactSolutions& exact) const
+{
+  if (reachability_map_.isLoaded() && !reachability_map_.isReachable(ik_pose))
   {
-    theta3 =
-        -2 * atan(sqrt(-(a1 * a1 * a1 * a1 + a2 * a2 * a2 * a2 + a3 * a3 * a3 * a3 + px * px * px * px +
-                         py * py * py * py + pz * pz * pz * pz - 2 * a1 * a1 * a2 * a2 - 2 * a1 * a1 * a3 * a3 -
-                         2 * a2 * a2 * a3 * a3 - 2 * a1 * a1 * px * px - 2 * a2 * a2 * px * px - 2 * a3 * a3 * px * px -
-                         2 * a1 * a1 * py * py - 2 * a2 * a2 * py * py - 2 * a3 * a3 * py * py + 2 * a1 * a1 * pz * pz -
-                         2 * a2 * a2 * pz * pz - 2 * a3 * a3 * pz * pz + 2 * px * px * py * py + 2 * px * px * pz * pz +
-                         2 * py * py * pz * pz + 8 * a1 * a2 * a3 * sqrt(px * px + py * py)) /
-                       ((px * px + py * py) *
-                            (-2 * a1 * a1 - 2 * a2 * a2 + 4 * a2 * a3 - 2 * a3 * a3 + px * px + py * py + 2 * pz * pz) -
-                        4 * a2 * a3 * a3 * a3 - 4 * a2 * a2 * a2 * a3 + a1 * a1 * a1 * a1 + a2 * a2 * a2 * a2 +
-                        a3 * a3 * a3 * a3 + pz * pz * pz * pz - 2 * a1 * a1 * a2 * a2 - 2 * a1 * a1 * a3 * a3 +
-                        6 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * pz * pz - 2 * a2 * a2 * pz * pz - 2 * a3 * a3 * pz * pz +
-                        4 * a1 * a1 * a2 * a3 + 4 * a2 * a3 * pz * pz)));
-  }
-  const auto t3 = real(theta3);
-  const auto s3 = sin(t3);
-  const auto c3 = cos(t3);
-
-  std::complex<double> theta2 =
-      (pz > 0) ?
-          (-2 *
-           atan((sqrt(-a1 * a1 * a1 * a1 + 2 * a1 * a1 * a2 * a2 + 4 * a1 * a1 * a2 * a3 * c3 +
-                      2 * a1 * a1 * a3 * a3 * c3 * c3 + 2 * a1 * a1 * a3 * a3 * s3 * s3 + 2 * a1 * a1 * px * px +
-                      2 * a1 * a1 * py * py + 2 * a1 * a1 * pz * pz - a2 * a2 * a2 * a2 - 4 * a2 * a2 * a2 * a3 * c3 -
-                      6 * a2 * a2 * a3 * a3 * c3 * c3 - 2 * a2 * a2 * a3 * a3 * s3 * s3 + 2 * a2 * a2 * px * px +
-                      2 * a2 * a2 * py * py + 2 * a2 * a2 * pz * pz - 4 * a2 * a3 * a3 * a3 * c3 * c3 * c3 -
-                      4 * a2 * a3 * a3 * a3 * c3 * s3 * s3 + 4 * a2 * a3 * c3 * px * px + 4 * a2 * a3 * c3 * py * py +
-                      4 * a2 * a3 * c3 * pz * pz - a3 * a3 * a3 * a3 * c3 * c3 * c3 * c3 -
-                      2 * a3 * a3 * a3 * a3 * c3 * c3 * s3 * s3 - a3 * a3 * a3 * a3 * s3 * s3 * s3 * s3 +
-                      2 * a3 * a3 * c3 * c3 * px * px + 2 * a3 * a3 * c3 * c3 * py * py +
-                      2 * a3 * a3 * c3 * c3 * pz * pz + 2 * a3 * a3 * px * px * s3 * s3 +
-                      2 * a3 * a3 * py * py * s3 * s3 + 2 * a3 * a3 * pz * pz * s3 * s3 - px * px * px * px -
-                      2 * px * px * py * py - 2 * px * px * pz * pz - py * py * py * py - 2 * py * py * pz * pz -
-                      pz * pz * pz * pz) +
-                 2 * a1 * a3 * s3) /
-                (-a1 * a1 + 2 * a1 * a2 + 2 * a1 * a3 * c3 - a2 * a2 - 2 * a2 * a3 * c3 - a3 * a3 * c3 * c3 -
-                 a3 * a3 * s3 * s3 + px * px + py * py + pz * pz))) :
-          (2 *
-           atan((sqrt(-a1 * a1 * a1 * a1 + 2 * a1 * a1 * a2 * a2 + 4 * a1 * a1 * a2 * a3 * c3 +
-                      2 * a1 * a1 * a3 * a3 * c3 * c3 + 2 * a1 * a1 * a3 * a3 * s3 * s3 + 2 * a1 * a1 * px * px +
-                      2 * a1 * a1 * py * py + 2 * a1 * a1 * pz * pz - a2 * a2 * a2 * a2 - 4 * a2 * a2 * a2 * a3 * c3 -
-                      6 * a2 * a2 * a3 * a3 * c3 * c3 - 2 * a2 * a2 * a3 * a3 * s3 * s3 + 2 * a2 * a2 * px * px +
-                      2 * a2 * a2 * py * py + 2 * a2 * a2 * pz * pz - 4 * a2 * a3 * a3 * a3 * c3 * c3 * c3 -
-                      4 * a2 * a3 * a3 * a3 * c3 * s3 * s3 + 4 * a2 * a3 * c3 * px * px + 4 * a2 * a3 * c3 * py * py +
-                      4 * a2 * a3 * c3 * pz * pz - a3 * a3 * a3 * a3 * c3 * c3 * c3 * c3 -
-                      2 * a3 * a3 * a3 * a3 * c3 * c3 * s3 * s3 - a3 * a3 * a3 * a3 * s3 * s3 * s3 * s3 +
-                      2 * a3 * a3 * c3 * c3 * px * px + 2 * a3 * a3 * c3 * c3 * py * py +
-                      2 * a3 * a3 * c3 * c3 * pz * pz + 2 * a3 * a3 * px * px * s3 * s3 +
-                      2 * a3 * a3 * py * py * s3 * s3 + 2 * a3 * a3 * pz * pz * s3 * s3 - px * px * px * px -
-                      2 * px * px * py * py - 2 * px * px * pz * pz - py * py * py * py - 2 * py * py * pz * pz -
-                      pz * pz * pz * pz) -
-                 2 * a1 * a3 * s3) /
-                (-a1 * a1 + 2 * a1 * a2 + 2 * a1 * a3 * c3 - a2 * a2 - 2 * a2 * a3 * c3 - a3 * a3 * c3 * c3 -
-                 a3 * a3 * s3 * s3 + px * px + py * py + pz * pz)));
-  const auto t2 = real(theta2);
-  const auto s2 = sin(t2);
-  const auto c2 = cos(t2);
-
-  std::complex<double> theta1;
-  const auto theta1_numerator = a1 - px + a2 * c2 + a3 * c2 * c3 - a3 * s2 * s3;
-  if (abs(theta1_numerator) < FLT_EPSILON)
-  {
-    theta1 = 0;
-  }
-  else if (p.x == 0 && p.y == 0 && roll < 0)
-  {
-    theta1 = -2 * atan(sqrt(theta1_numerator / (a1 + px + a2 * c2 + a3 * c2 * c3 - a3 * s2 * s3)));
+    exact.solution_num = 0;
+    return;
   }
-  else
+
+  // The seed state only orders the exact solutions, so the cache holds them for any seed. Every theta1 is exact where
+  // it is free, so the cached one is as good as free_theta1.
+  if (!ik_cache_)
   {
-    theta1 = 2 * atan(sqrt(theta1_numerator / (a1 + px + a2 * c2 + a3 * c2 * c3 - a3 * s2 * s3)));
-  }
-  const auto t1 = real(theta1);
-  const auto s1 = sin(t1);
-  const auto c1 = cos(t1);
-
-  const auto t4 = atan2(
-      (az * (c2 * s3 + c3 * s2)) / (c2 * c2 * c3 * c3 + c2 * c2 * s3 * s3 + c3 * c3 * s2 * s2 + s2 * s2 * s3 * s3) -
-          (ax * (c1 * c2 * c3 - c1 * s2 * s3)) /
-              (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-               c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-               c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3) -
-          (ay * (c2 * c3 * s1 - s1 * s2 * s3)) /
-              (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-               c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-               c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3),
-      -(ax * (c1 * c2 * s3 + c1 * c3 * s2)) /
-              (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-               c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-               c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3) -
-          (az * (c2 * c3 - s2 * s3)) / (c2 * c2 * c3 * c3 + c2 * c2 * s3 * s3 + c3 * c3 * s2 * s2 + s2 * s2 * s3 * s3) -
-          (ay * s1 * (c2 * s3 + c3 * s2)) /
-              (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-               c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-               c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3));
-  const auto s4 = sin(t4);
-  const auto c4 = cos(t4);
-
-  const auto t5 = atan2(((oz * (c2 * c3 * s4 + c2 * c4 * s3 + c3 * c4 * s2 - s2 * s3 * s4)) /
-                             (c2 * c2 * c3 * c3 * c4 * c4 + c2 * c2 * c3 * c3 * s4 * s4 + c2 * c2 * c4 * c4 * s3 * s3 +
-                              c2 * c2 * s3 * s3 * s4 * s4 + c3 * c3 * c4 * c4 * s2 * s2 + c3 * c3 * s2 * s2 * s4 * s4 +
-                              c4 * c4 * s2 * s2 * s3 * s3 + s2 * s2 * s3 * s3 * s4 * s4) +
-                         (oy * (c2 * s1 * s3 * s4 + c3 * s1 * s2 * s4 + c4 * s1 * s2 * s3 - c2 * c3 * c4 * s1)) /
-                             (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                              c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                              c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                              c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                              c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                              c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                              c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                              c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4) +
-                         (c1 * ox * (c2 * s3 * s4 - c2 * c3 * c4 + c3 * s2 * s4 + c4 * s2 * s3)) /
-                             (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                              c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                              c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                              c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                              c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                              c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                              c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                              c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4)),
-                        (-(nz * (c2 * c3 * s4 + c2 * c4 * s3 + c3 * c4 * s2 - s2 * s3 * s4)) /
-                             (c2 * c2 * c3 * c3 * c4 * c4 + c2 * c2 * c3 * c3 * s4 * s4 + c2 * c2 * c4 * c4 * s3 * s3 +
-                              c2 * c2 * s3 * s3 * s4 * s4 + c3 * c3 * c4 * c4 * s2 * s2 + c3 * c3 * s2 * s2 * s4 * s4 +
-                              c4 * c4 * s2 * s2 * s3 * s3 + s2 * s2 * s3 * s3 * s4 * s4) -
-                         (ny * (c2 * s1 * s3 * s4 + c3 * s1 * s2 * s4 + c4 * s1 * s2 * s3 - c2 * c3 * c4 * s1)) /
-                             (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                              c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                              c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                              c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                              c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                              c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                              c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                              c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4) -
-                         (c1 * nx * (c2 * s3 * s4 - c2 * c3 * c4 + c3 * s2 * s4 + c4 * s2 * s3)) /
-                             (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                              c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                              c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                              c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                              c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                              c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                              c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                              c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4)));
-
-  solution.resize(JOINT_NUM);
-  solution[0] = t1;             // arm_joint1
-  solution[1] = t2 + M_PI / 2;  // arm_joint2
-  solution[2] = t3;             // arm_joint3
-  solution[3] = t4 + M_PI / 2;  // arm_joint4
-  solution[4] = asin(sin(t5));  // arm_joint5
-
-  // Check the solution and joints' limits
-  for (auto i = 0; i < JOINT_NUM; ++i)
+    exact.solution_num = solveIkExact(ik_pose, free_theta1, deadline, exact.solutions);
+    return;
+  }
+
+  // A result that the deadline cut short would stay in the cache for any later timeout
+  const auto key = ik_cache_->makeKey(ik_pose);
+  if (!ik_cache_->find(key, exact))
   {
-    if (std::isnan(solution[i]))
+    auto is_truncated = false;
+    exact.solution_num = solveIkExact(ik_pose, free_theta1, deadline, exact.solutions, &is_truncated);
+    if (!is_truncated)
     {
-      ROS_ERROR_NAMED("xarm_kinematics_plugin", "The value of arm_joint%d is not a number", i + 1);
-      return false;
+      ik_cache_->insert(key, exact);
     }
-    else if (solution[i] < lower_limits_[i] || solution[i] > upper_limits_[i])
+  }
+}
+
+int XarmKinematicsPlugin::solveIkSortedBySeed(const geometry_msgs::Pose& ik_pose,
+                                              const std::vector<double>& ik_seed_state,
+                                              const std::vector<double>& consistency_limits,
+                                              const ros::WallTime& deadline, Candidates& solutions) const
+{
+  // Where theta1 is free it takes the one of the seed state
+  ExactSolutions exact;
+  findExactSolutions(ik_pose, ik_seed_state[0], deadline, exact);
+
+  // Distances to the seed state and indices of the solutions
+  std::array<std::pair<double, int>, CANDIDATE_NUM> ranking;
+  auto ranking_end = ranking.begin();
+  for (auto i = 0; i < exact.solution_num; ++i)
+  {
+    if (isSolutionConsistent(exact.solutions[i], ik_seed_state, consistency_limits))
     {
-      ROS_ERROR_NAMED("xarm_kinematics_plugin", "The value of arm_joint%d (%f) is out of bounds", i + 1, solution[i]);
-      // return false;
+      *ranking_end++ = std::make_pair(getSeedDistance(exact.solutions[i], ik_seed_state), i);
     }
   }
+  std::sort(ranking.begin(), ranking_end);
 
-  return true;
+  auto solution_num = 0;
+  for (auto rank = ranking.begin(); rank != ranking_end; ++rank)
+  {
+    solutions[solution_num++] = exact.solutions[rank->second];
+  }
+
+  return solution_num;
 }
 
-bool XarmKinematicsPlugin::solveIkFromAllPossibleSolutions(const geometry_msgs::Pose& ik_pose,
-                                                           std::vector<double>& solution) const
+bool XarmKinematicsPlugin::solveIkDifferential(const geometry_msgs::Pose& ik_pose,
+                                               const std::vector<double>& ik_seed_state,
+                                               const std::vector<double>& consistency_limits,
+                                               JointValues& solution) const
 {
-  const auto p = ik_pose.position;
-
+  // The IK reads the target as Rz(azimuth) * Ry(pitch) * Rx(roll), which the arm reaches with theta2 + theta3 +
+  // theta4 - pi / 2 = pitch and theta5 = roll, or with pi - pitch and roll + pi when it reaches over the Z axis
   double roll, pitch, yaw;
   quaternionToRpy(ik_pose.orientation, roll, pitch, yaw);
 
-  // Convert quaternion to rotation matrix
-  tf::Matrix3x3 r;
-  yaw = atan2(p.y, p.x);
-  r.setRPY(roll, pitch, yaw);
-
-  // Parameters
-  constexpr double a1 = 0.003;
-  constexpr double a2 = 0.096;
-  constexpr double a3 = 0.096;
-  constexpr double base_height = 0.072;  // Height of base relative to world
-  constexpr double tool_length = 0.12;   // Length of terminal tool
-
-  // Transformation from the tool frame to the last frame on the manipulator
-  double nx = r[0][2], ny = r[1][2], nz = r[2][2];
-  double ox = -r[0][1], oy = -r[1][1], oz = -r[2][1];
-  double ax = r[0][0], ay = r[1][0], az = r[2][0];
-  double px = p.x - tool_length * r[0][0];
-  double py = p.y - tool_length * r[1][0];
-  double pz = p.z - tool_length * r[2][0] - base_height;
-
-  // Singular point
-  const double temp = 2 * a1 * a1 * a2 * a2 - a2 * a2 * a2 * a2 - a3 * a3 * a3 * a3 - px * px * px * px -
-                      py * py * py * py - pz * pz * pz * pz - a1 * a1 * a1 * a1 + 2 * a1 * a1 * a3 * a3 +
-                      2 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * px * px + 2 * a2 * a2 * px * px + 2 * a3 * a3 * px * px +
-                      2 * a1 * a1 * py * py + 2 * a2 * a2 * py * py + 2 * a3 * a3 * py * py - 2 * a1 * a1 * pz * pz +
-                      2 * a2 * a2 * pz * pz + 2 * a3 * a3 * pz * pz - 2 * px * px * py * py - 2 * px * px * pz * pz -
-                      2 * py * py * pz * pz + 8 * a1 * a2 * a3 * sqrt(px * px + py * py);
-  if (temp < 0)
-  {
-    r.setRPY(roll, pitch, 0);
-    r *= tf::Matrix3x3(0, 0, 1, 0, -1, 0, 1, 0, 0);
-    nx = r[0][2], ny = r[1][2], nz = r[2][2];
-    ox = -r[0][1], oy = -r[1][1], oz = -r[2][1];
-    ax = r[0][0], ay = r[1][0], az = r[2][0];
-    px = p.x - tool_length * r[0][0];
-    py = p.y - tool_length * r[1][0];
-    pz = p.z - tool_length * r[2][0] - base_height;
-  }
-
-  // All possible solutions of theta 3
-  std::vector<double> theta3_list;
-  theta3_list.push_back(real(std::complex<double>(
-      2 * atan(sqrt((2 * a1 * a1 * a2 * a2 - a2 * a2 * a2 * a2 - a3 * a3 * a3 * a3 - px * px * px * px -
-                     py * py * py * py - pz * pz * pz * pz - a1 * a1 * a1 * a1 + 2 * a1 * a1 * a3 * a3 +
-                     2 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * px * px + 2 * a2 * a2 * px * px + 2 * a3 * a3 * px * px +
-                     2 * a1 * a1 * py * py + 2 * a2 * a2 * py * py + 2 * a3 * a3 * py * py - 2 * a1 * a1 * pz * pz +
-                     2 * a2 * a2 * pz * pz + 2 * a3 * a3 * pz * pz - 2 * px * px * py * py - 2 * px * px * pz * pz -
-                     2 * py * py * pz * pz + 8 * a1 * a2 * a3 * sqrt(px * px + py * py)) /
-                    ((px * px + py * py) *
-                         (-2 * a1 * a1 - 2 * a2 * a2 + 4 * a2 * a3 - 2 * a3 * a3 + px * px + py * py + 2 * pz * pz) -
-                     4 * a2 * a3 * a3 * a3 - 4 * a2 * a2 * a2 * a3 + a1 * a1 * a1 * a1 + a2 * a2 * a2 * a2 +
-                     a3 * a3 * a3 * a3 + pz * pz * pz * pz - 2 * a1 * a1 * a2 * a2 - 2 * a1 * a1 * a3 * a3 +
-                     6 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * pz * pz - 2 * a2 * a2 * pz * pz - 2 * a3 * a3 * pz * pz +
-                     4 * a1 * a1 * a2 * a3 + 4 * a2 * a3 * pz * pz))))));
-  theta3_list.push_back(real(std::complex<double>(
-      -2 * atan(sqrt(-(a1 * a1 * a1 * a1 + a2 * a2 * a2 * a2 + a3 * a3 * a3 * a3 + px * px * px * px +
-                       py * py * py * py + pz * pz * pz * pz - 2 * a1 * a1 * a2 * a2 - 2 * a1 * a1 * a3 * a3 -
-                       2 * a2 * a2 * a3 * a3 - 2 * a1 * a1 * px * px - 2 * a2 * a2 * px * px - 2 * a3 * a3 * px * px -
-                       2 * a1 * a1 * py * py - 2 * a2 * a2 * py * py - 2 * a3 * a3 * py * py + 2 * a1 * a1 * pz * pz -
-                       2 * a2 * a2 * pz * pz - 2 * a3 * a3 * pz * pz + 2 * px * px * py * py + 2 * px * px * pz * pz +
-                       2 * py * py * pz * pz + 8 * a1 * a2 * a3 * sqrt(px * px + py * py)) /
-                     ((px * px + py * py) *
-                          (-2 * a1 * a1 - 2 * a2 * a2 + 4 * a2 * a3 - 2 * a3 * a3 + px * px + py * py + 2 * pz * pz) -
-                      4 * a2 * a3 * a3 * a3 - 4 * a2 * a2 * a2 * a3 + a1 * a1 * a1 * a1 + a2 * a2 * a2 * a2 +
-                      a3 * a3 * a3 * a3 + pz * pz * pz * pz - 2 * a1 * a1 * a2 * a2 - 2 * a1 * a1 * a3 * a3 +
-                      6 * a2 * a2 * a3 * a3 + 2 * a1 * a1 * pz * pz - 2 * a2 * a2 * pz * pz - 2 * a3 * a3 * pz * pz +
-                      4 * a1 * a1 * a2 * a3 + 4 * a2 * a3 * pz * pz))))));
-  theta3_list.push_back(-theta3_list[0]);
-  theta3_list.push_back(-theta3_list[1]);
-
-  // All possible solutions of theta 2
-  std::vector<double> theta2_list;
-  for (const auto& t3 : theta3_list)
-  {
-    const auto s3 = sin(t3);
-    const auto c3 = cos(t3);
-
-    theta2_list.push_back(real(std::complex<double>(
-        2 *
-        atan((sqrt(-a1 * a1 * a1 * a1 + 2 * a1 * a1 * a2 * a2 + 4 * a1 * a1 * a2 * a3 * c3 +
-                   2 * a1 * a1 * a3 * a3 * c3 * c3 + 2 * a1 * a1 * a3 * a3 * s3 * s3 + 2 * a1 * a1 * px * px +
-                   2 * a1 * a1 * py * py + 2 * a1 * a1 * pz * pz - a2 * a2 * a2 * a2 - 4 * a2 * a2 * a2 * a3 * c3 -
-                   6 * a2 * a2 * a3 * a3 * c3 * c3 - 2 * a2 * a2 * a3 * a3 * s3 * s3 + 2 * a2 * a2 * px * px +
-                   2 * a2 * a2 * py * py + 2 * a2 * a2 * pz * pz - 4 * a2 * a3 * a3 * a3 * c3 * c3 * c3 -
-                   4 * a2 * a3 * a3 * a3 * c3 * s3 * s3 + 4 * a2 * a3 * c3 * px * px + 4 * a2 * a3 * c3 * py * py +
-                   4 * a2 * a3 * c3 * pz * pz - a3 * a3 * a3 * a3 * c3 * c3 * c3 * c3 -
-                   2 * a3 * a3 * a3 * a3 * c3 * c3 * s3 * s3 - a3 * a3 * a3 * a3 * s3 * s3 * s3 * s3 +
-                   2 * a3 * a3 * c3 * c3 * px * px + 2 * a3 * a3 * c3 * c3 * py * py + 2 * a3 * a3 * c3 * c3 * pz * pz +
-                   2 * a3 * a3 * px * px * s3 * s3 + 2 * a3 * a3 * py * py * s3 * s3 + 2 * a3 * a3 * pz * pz * s3 * s3 -
-                   px * px * px * px - 2 * px * px * py * py - 2 * px * px * pz * pz - py * py * py * py -
-                   2 * py * py * pz * pz - pz * pz * pz * pz) -
-              2 * a1 * a3 * s3) /
-             (-a1 * a1 + 2 * a1 * a2 + 2 * a1 * a3 * c3 - a2 * a2 - 2 * a2 * a3 * c3 - a3 * a3 * c3 * c3 -
-              a3 * a3 * s3 * s3 + px * px + py * py + pz * pz)))));
-    theta2_list.push_back(real(std::complex<double>(
-        -2 *
-        atan((sqrt(-a1 * a1 * a1 * a1 + 2 * a1 * a1 * a2 * a2 + 4 * a1 * a1 * a2 * a3 * c3 +
-                   2 * a1 * a1 * a3 * a3 * c3 * c3 + 2 * a1 * a1 * a3 * a3 * s3 * s3 + 2 * a1 * a1 * px * px +
-                   2 * a1 * a1 * py * py + 2 * a1 * a1 * pz * pz - a2 * a2 * a2 * a2 - 4 * a2 * a2 * a2 * a3 * c3 -
-                   6 * a2 * a2 * a3 * a3 * c3 * c3 - 2 * a2 * a2 * a3 * a3 * s3 * s3 + 2 * a2 * a2 * px * px +
-                   2 * a2 * a2 * py * py + 2 * a2 * a2 * pz * pz - 4 * a2 * a3 * a3 * a3 * c3 * c3 * c3 -
-                   4 * a2 * a3 * a3 * a3 * c3 * s3 * s3 + 4 * a2 * a3 * c3 * px * px + 4 * a2 * a3 * c3 * py * py +
-                   4 * a2 * a3 * c3 * pz * pz - a3 * a3 * a3 * a3 * c3 * c3 * c3 * c3 -
-                   2 * a3 * a3 * a3 * a3 * c3 * c3 * s3 * s3 - a3 * a3 * a3 * a3 * s3 * s3 * s3 * s3 +
-                   2 * a3 * a3 * c3 * c3 * px * px + 2 * a3 * a3 * c3 * c3 * py * py + 2 * a3 * a3 * c3 * c3 * pz * pz +
-                   2 * a3 * a3 * px * px * s3 * s3 + 2 * a3 * a3 * py * py * s3 * s3 + 2 * a3 * a3 * pz * pz * s3 * s3 -
-                   px * px * px * px - 2 * px * px * py * py - 2 * px * px * pz * pz - py * py * py * py -
-                   2 * py * py * pz * pz - pz * pz * pz * pz) +
-              2 * a1 * a3 * s3) /
-             (-a1 * a1 + 2 * a1 * a2 + 2 * a1 * a3 * c3 - a2 * a2 - 2 * a2 * a3 * c3 - a3 * a3 * c3 * c3 -
-              a3 * a3 * s3 * s3 + px * px + py * py + pz * pz)))));
-  }
-
-  // All possible solutions of theta 1
-  std::vector<double> theta1_list;
-  for (auto i = 0; i < theta2_list.size(); ++i)
-  {
-    const auto t2 = theta2_list[i];
-    const auto s2 = sin(t2);
-    const auto c2 = cos(t2);
-
-    const auto t3 = theta3_list[i / 2];
-    const auto s3 = sin(t3);
-    const auto c3 = cos(t3);
-
-    const auto theta1_numerator = a1 - px + a2 * c2 + a3 * c2 * c3 - a3 * s2 * s3;
-    if (abs(theta1_numerator) < FLT_EPSILON)
-    {
-      theta1_list.push_back(0);
-      theta1_list.push_back(0);
+  std::copy(ik_seed_state.cbegin(), ik_seed_state.cend(), solution.begin());
+  auto is_over = false;
+  auto last_error = std::numeric_limits<double>::infinity();
+  for (auto iteration = 0; iteration < differential_iteration_num; ++iteration)
+  {
+    std::array<double, 3> position;
+    Jacobian jacobian;
+    Kinematics::computeToolPositionAndJacobian(solution.data(), position, jacobian);
+    if (iteration == 0)
+    {
+      is_over = position[0] * cos(solution[0]) + position[1] * sin(solution[0]) < 0;
+    }
+
+    // Error of the pose, the angles wrapped to [-pi, pi]
+    JointValues error{ { ik_pose.position.x - position[0], ik_pose.position.y - position[1],
+                                           ik_pose.position.z - position[2],
+                                           (is_over ? M_PI - pitch : pitch) -
+                                               (solution[1] + solution[2] + solution[3] - M_PI / 2),
+                                           (is_over ? roll + M_PI : roll) - solution[4] } };
+    error[3] = remainder(error[3], 2 * M_PI);
+    error[4] = remainder(error[4], 2 * M_PI);
+
+    const auto max_error = std::abs(*std::max_element(error.cbegin(), error.cend(), [](double a, double b) {
+      return std::abs(a) < std::abs(b);
+    }));
+    if ((iteration == 0 && max_error > differential_ik_max_step_) || max_error > last_error)
+    {
+      return false;  // Too far or diverging, e.g. the target is on another branch
     }
-    else
+    if (max_error < solution_tolerance * 1e-2)
     {
-      auto theta1 = real(
-          std::complex<double>(2 * atan(sqrt(theta1_numerator / (a1 + px + a2 * c2 + a3 * c2 * c3 - a3 * s2 * s3)))));
-      theta1_list.push_back(theta1);
-      theta1_list.push_back(-theta1);
-    }
-  }
-
-  // All possible solutions
-  std::vector<std::vector<double>> all_solutions;
-  for (auto i = 0; i < theta1_list.size(); ++i)
-  {
-    const auto t1 = theta1_list[i];
-    const auto s1 = sin(t1);
-    const auto c1 = cos(t1);
-
-    const auto t2 = theta2_list[i / 2];
-    const auto s2 = sin(t2);
-    const auto c2 = cos(t2);
-
-    const auto t3 = theta3_list[i / 4];
-    const auto s3 = sin(t3);
-    const auto c3 = cos(t3);
-
-    const auto t4 = atan2(
-        (az * (c2 * s3 + c3 * s2)) / (c2 * c2 * c3 * c3 + c2 * c2 * s3 * s3 + c3 * c3 * s2 * s2 + s2 * s2 * s3 * s3) -
-            (ax * (c1 * c2 * c3 - c1 * s2 * s3)) /
-                (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-                 c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-                 c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3) -
-            (ay * (c2 * c3 * s1 - s1 * s2 * s3)) /
-                (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-                 c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-                 c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3),
-        -(ax * (c1 * c2 * s3 + c1 * c3 * s2)) /
-                (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-                 c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-                 c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3) -
-            (az * (c2 * c3 - s2 * s3)) /
-                (c2 * c2 * c3 * c3 + c2 * c2 * s3 * s3 + c3 * c3 * s2 * s2 + s2 * s2 * s3 * s3) -
-            (ay * s1 * (c2 * s3 + c3 * s2)) /
-                (c1 * c1 * c2 * c2 * c3 * c3 + c1 * c1 * c2 * c2 * s3 * s3 + c1 * c1 * c3 * c3 * s2 * s2 +
-                 c1 * c1 * s2 * s2 * s3 * s3 + c2 * c2 * c3 * c3 * s1 * s1 + c2 * c2 * s1 * s1 * s3 * s3 +
-                 c3 * c3 * s1 * s1 * s2 * s2 + s1 * s1 * s2 * s2 * s3 * s3));
-    const auto s4 = sin(t4);
-    const auto c4 = cos(t4);
-
-    const auto t5 =
-        atan2(((oz * (c2 * c3 * s4 + c2 * c4 * s3 + c3 * c4 * s2 - s2 * s3 * s4)) /
-                   (c2 * c2 * c3 * c3 * c4 * c4 + c2 * c2 * c3 * c3 * s4 * s4 + c2 * c2 * c4 * c4 * s3 * s3 +
-                    c2 * c2 * s3 * s3 * s4 * s4 + c3 * c3 * c4 * c4 * s2 * s2 + c3 * c3 * s2 * s2 * s4 * s4 +
-                    c4 * c4 * s2 * s2 * s3 * s3 + s2 * s2 * s3 * s3 * s4 * s4) +
-               (oy * (c2 * s1 * s3 * s4 + c3 * s1 * s2 * s4 + c4 * s1 * s2 * s3 - c2 * c3 * c4 * s1)) /
-                   (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                    c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                    c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                    c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                    c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                    c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                    c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                    c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4) +
-               (c1 * ox * (c2 * s3 * s4 - c2 * c3 * c4 + c3 * s2 * s4 + c4 * s2 * s3)) /
-                   (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                    c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                    c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                    c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                    c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                    c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                    c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                    c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4)),
-              (-(nz * (c2 * c3 * s4 + c2 * c4 * s3 + c3 * c4 * s2 - s2 * s3 * s4)) /
-                   (c2 * c2 * c3 * c3 * c4 * c4 + c2 * c2 * c3 * c3 * s4 * s4 + c2 * c2 * c4 * c4 * s3 * s3 +
-                    c2 * c2 * s3 * s3 * s4 * s4 + c3 * c3 * c4 * c4 * s2 * s2 + c3 * c3 * s2 * s2 * s4 * s4 +
-                    c4 * c4 * s2 * s2 * s3 * s3 + s2 * s2 * s3 * s3 * s4 * s4) -
-               (ny * (c2 * s1 * s3 * s4 + c3 * s1 * s2 * s4 + c4 * s1 * s2 * s3 - c2 * c3 * c4 * s1)) /
-                   (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                    c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                    c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                    c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                    c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                    c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                    c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                    c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4) -
-               (c1 * nx * (c2 * s3 * s4 - c2 * c3 * c4 + c3 * s2 * s4 + c4 * s2 * s3)) /
-                   (c1 * c1 * c2 * c2 * c3 * c3 * c4 * c4 + c1 * c1 * c2 * c2 * c3 * c3 * s4 * s4 +
-                    c1 * c1 * c2 * c2 * c4 * c4 * s3 * s3 + c1 * c1 * c2 * c2 * s3 * s3 * s4 * s4 +
-                    c1 * c1 * c3 * c3 * c4 * c4 * s2 * s2 + c1 * c1 * c3 * c3 * s2 * s2 * s4 * s4 +
-                    c1 * c1 * c4 * c4 * s2 * s2 * s3 * s3 + c1 * c1 * s2 * s2 * s3 * s3 * s4 * s4 +
-                    c2 * c2 * c3 * c3 * c4 * c4 * s1 * s1 + c2 * c2 * c3 * c3 * s1 * s1 * s4 * s4 +
-                    c2 * c2 * c4 * c4 * s1 * s1 * s3 * s3 + c2 * c2 * s1 * s1 * s3 * s3 * s4 * s4 +
-                    c3 * c3 * c4 * c4 * s1 * s1 * s2 * s2 + c3 * c3 * s1 * s1 * s2 * s2 * s4 * s4 +
-                    c4 * c4 * s1 * s1 * s2 * s2 * s3 * s3 + s1 * s1 * s2 * s2 * s3 * s3 * s4 * s4)));
-
-    std::vector<double> possible_solution(JOINT_NUM, 0);
-    possible_solution[0] = (t1);
-    possible_solution[1] = (t2 + M_PI / 2);
-    possible_solution[2] = (t3);
-    possible_solution[3] = (t4 + M_PI / 2);
-    possible_solution[4] = (asin(sin(t5)));
-
-    all_solutions.push_back(possible_solution);
-  }
-
-  for (const auto& possible_solution : all_solutions)
-  {
-    if (isSolutionValid(possible_solution))
-    {
-      solution = possible_solution;
-      return true;
+      break;
+    }
+    last_error = max_error;
+
+    if (!Kinematics::solveJacobian(jacobian, error, jacobian_min_pivot))
+    {
+      return false;
+    }
+    for (auto i = 0; i < JOINT_NUM; ++i)
+    {
+      solution[i] += error[i];
     }
   }
 
-  return false;
+  // The same acceptance as the closed-form candidates, the RPY angles of the target may also describe another branch
+  IkTarget ik_target;
+  computeIkTarget(ik_pose, ik_target);
+  return isSolutionValid(solution) && Kinematics::isSolutionExact(solution, ik_target, solution_tolerance) &&
+         isSolutionConsistent(solution, ik_seed_state, consistency_limits);
+}
+
+void XarmKinematicsPlugin::solveBatch(const geometry_msgs::Pose* poses, std::size_t pose_num,
+                                      BatchSolution* solutions) const
+{
+  using simd::DoubleVec;
+  using simd::broadcast;
+  using simd::select;
+  constexpr auto max_reach_sq = Kinematics::max_reach_sq;
+  constexpr auto min_reach_sq = Kinematics::min_reach_sq;
+
+  for (std::size_t offset = 0; offset < pose_num; offset += SIMD_LANES)
+  {
+    // Structure of arrays, the last block is padded with its last pose. Lanes with an orientation out of the plane of
+    // the arm have no solution, as in searchPositionIK().
+    DoubleVec nx, ny, nz, ox, oy, oz, ax, ay, az, px, py, pz, near_sq, far_sq;
+    std::array<IkTarget, SIMD_LANES> targets;
+    std::array<bool, SIMD_LANES> solvable;
+    for (auto lane = 0; lane < SIMD_LANES; ++lane)
+    {
+      const auto& pose = poses[std::min(offset + lane, pose_num - 1)];
+      geometry_msgs::Pose solvable_pose;
+      solvable[lane] = getSolvablePose(pose, kinematics::KinematicsQueryOptions(), solvable_pose);
+
+      auto& target = targets[lane];
+      computeIkTarget(pose, target);
+      nx[lane] = target.nx, ny[lane] = target.ny, nz[lane] = target.nz;
+      ox[lane] = target.ox, oy[lane] = target.oy, oz[lane] = target.oz;
+      ax[lane] = target.ax, ay[lane] = target.ay, az[lane] = target.az;
+      px[lane] = target.px, py[lane] = target.py, pz[lane] = target.pz;
+      near_sq[lane] = target.near_sq, far_sq[lane] = target.far_sq;
+    }
+    const auto p_sq = px * px + py * py + pz * pz;
+
+    // Same steps as XarmKinematicsCore::computeAllPossibleSolutions(), producing the candidates in the same order
+    std::array<std::array<DoubleVec, JOINT_NUM>, CANDIDATE_NUM> candidates;
+    auto candidate_it = candidates.begin();
+
+    // Differences that rounding pushes slightly below zero at the boundary of the workspace are zero
+    const auto clamp_to_boundary = [](DoubleVec difference, DoubleVec scale) {
+      return select((difference < 0) & (difference > -64 * DBL_EPSILON * scale), broadcast(0), difference);
+    };
+
+    // Joint values of theta2 and theta4 in (-pi, pi], the angles of atan2 are offset by pi / 2
+    const auto wrap_offset_angle = [](DoubleVec angle) {
+      return select(angle > M_PI / 2, angle - 3 * M_PI / 2, angle + M_PI / 2);
+    };
+
+    const auto denominator3 = (near_sq - min_reach_sq) * (far_sq - min_reach_sq);
+    const auto near_difference = clamp_to_boundary(max_reach_sq - near_sq, broadcast(max_reach_sq));
+    const auto far_difference = clamp_to_boundary(max_reach_sq - far_sq, broadcast(max_reach_sq));
+    const auto theta3_near = 2 * simd::atan(simd::sqrt(near_difference * (far_sq - min_reach_sq) / denominator3));
+    const auto theta3_far = -2 * simd::atan(simd::sqrt(far_difference * (near_sq - min_reach_sq) / denominator3));
+    const DoubleVec theta3_list[] = { theta3_near, theta3_far, -theta3_near, -theta3_far };
+
+    for (const auto& t3 : theta3_list)
+    {
+      DoubleVec s3, c3;
+      simd::sincos(t3, s3, c3);
+
+      const auto reach_sq = a2 * a2 + a3 * a3 + 2 * a2 * a3 * c3;
+      const auto k = p_sq - a1 * a1 - reach_sq;
+      const auto root2 = simd::sqrt(clamp_to_boundary(4 * a1 * a1 * reach_sq - k * k, 4 * a1 * a1 * reach_sq));
+      const auto denominator2 = k + 2 * a1 * (a2 + a3 * c3);
+      const DoubleVec theta2_list[] = { 2 * simd::atan((root2 - 2 * a1 * a3 * s3) / denominator2),
+                                        -2 * simd::atan((root2 + 2 * a1 * a3 * s3) / denominator2) };
+
+      for (const auto& t2 : theta2_list)
+      {
+        DoubleVec s2, c2;
+        simd::sincos(t2, s2, c2);
+        const auto s23 = c2 * s3 + c3 * s2;
+        const auto c23 = c2 * c3 - s2 * s3;
+
+        const auto reach = a1 + a2 * c2 + a3 * c23;
+        const auto t1 = select(simd::abs(px) > simd::abs(reach) + FLT_EPSILON, broadcast(NAN),
+                               simd::atan2(simd::abs(py), select(reach < 0, -px, px)));
+        DoubleVec s1_positive, c1;
+        simd::sincos(t1, s1_positive, c1);
+
+        for (const auto sign : { 1.0, -1.0 })
+        {
+          const auto s1 = sign * s1_positive;
+
+          const auto a_radial = ax * c1 + ay * s1;
+          const auto y4 = az * s23 - a_radial * c23;
+          const auto x4 = -a_radial * s23 - az * c23;
+          const auto t4 = simd::atan2(y4, x4);
+
+          const auto s234 = s23 * x4 + c23 * y4;
+          const auto c234 = c23 * x4 - s23 * y4;
+          const auto t5 =
+              simd::atan2(oz * s234 - (ox * c1 + oy * s1) * c234, (nx * c1 + ny * s1) * c234 - nz * s234);
+
+          *candidate_it++ = { sign * t1, wrap_offset_angle(t2), t3, wrap_offset_angle(t4), t5 };
+        }
+      }
+    }
+
+    // The first valid and exact candidate of every lane. Near singularities the rounding of the closed-form solution
+    // leaves residuals, those lanes take the scalar solution, which handles the singularities and refines candidates.
+    for (auto lane = 0; lane < SIMD_LANES && offset + lane < pose_num; ++lane)
+    {
+      auto& result = solutions[offset + lane];
+      result.found = false;
+      if (!solvable[lane])
+      {
+        continue;
+      }
+
+      for (const auto& candidate : candidates)
+      {
+        JointValues solution;
+        for (auto i = 0; i < JOINT_NUM; ++i)
+        {
+          solution[i] = candidate[i][lane];
+        }
+        if (isSolutionValid(solution) && Kinematics::isSolutionExact(solution, targets[lane], solution_tolerance))
+        {
+          result.found = true;
+          result.joint_values = solution;
+          break;
+        }
+      }
+
+      if (!result.found)
+      {
+        ExactSolutions exact;
+        findExactSolutions(poses[offset + lane], 0, ros::WallTime::now() + ros::WallDuration(default_timeout_), exact);
+        result.found = exact.solution_num > 0;
+
+        // The solution closest to the zero seed state by getSeedDistance(), which theta1 = 0 above matches
+        auto min_distance = std::numeric_limits<double>::infinity();
+        for (auto i = 0; i < exact.solution_num; ++i)
+        {
+          auto distance = 0.0;
+          for (auto j = 0; j < JOINT_NUM; ++j)
+          {
+            distance += joint_weights_[j] * exact.solutions[i][j] * exact.solutions[i][j];
+          }
+          if (distance < min_distance)
+          {
+            min_distance = distance;
+            result.joint_values = exact.solutions[i];
+          }
+        }
+      }
+    }
+  }
 }
 
 }  // namespace xarm_kinematics_plugin
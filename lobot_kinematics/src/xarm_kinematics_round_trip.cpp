@@ -0,0 +1,290 @@
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <ros/ros.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "xarm_kinematics_plugin/xarm_kinematics_plugin.h"
+
+using xarm_kinematics_plugin::XarmKinematicsPlugin;
+
+namespace
+{
+// Samples that a worker takes at once, each chunk has its own seed so the sweep does not depend on the thread number
+constexpr int chunk_size = 4096;
+
+// Largest difference of a joint from the sampled value for a solution to be the sampled branch, in radians
+constexpr double branch_tolerance = 1e-6;
+
+// Errors by decade, [0, 1e-12), [1e-12, 1e-11) ... [1e-3, inf)
+constexpr int error_bin_num = 11;
+
+typedef std::array<std::uint64_t, error_bin_num> ErrorHistogram;
+
+struct Totals
+{
+  std::uint64_t sample_num;
+  std::uint64_t solved_num;     // By searchPositionIK() from the home pose
+  std::uint64_t recovered_num;  // With the sampled joint values among all solutions of getPositionIK()
+  double ik_seconds;            // In searchPositionIK()
+  double max_position_error;
+  double max_orientation_error;
+  double position_error_sum;
+  double orientation_error_sum;
+  ErrorHistogram position_histogram;
+  ErrorHistogram orientation_histogram;
+
+  void add(const Totals& other)
+  {
+    sample_num += other.sample_num;
+    solved_num += other.solved_num;
+    recovered_num += other.recovered_num;
+    ik_seconds += other.ik_seconds;
+    max_position_error = std::max(max_position_error, other.max_position_error);
+    max_orientation_error = std::max(max_orientation_error, other.max_orientation_error);
+    position_error_sum += other.position_error_sum;
+    orientation_error_sum += other.orientation_error_sum;
+    for (auto bin = 0; bin < error_bin_num; ++bin)
+    {
+      position_histogram[bin] += other.position_histogram[bin];
+      orientation_histogram[bin] += other.orientation_histogram[bin];
+    }
+  }
+};
+
+int getErrorBin(double error)
+{
+  if (!(error >= 1e-12))
+  {
+    return error < 1e-12 ? 0 : error_bin_num - 1;  // NaN counts as the largest error
+  }
+  return std::min(static_cast<int>(std::floor(std::log10(error))) + 13, error_bin_num - 1);
+}
+
+double getPositionError(const geometry_msgs::Pose& a, const geometry_msgs::Pose& b)
+{
+  const auto dx = a.position.x - b.position.x;
+  const auto dy = a.position.y - b.position.y;
+  const auto dz = a.position.z - b.position.z;
+  return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// Angle of the rotation from a to b, from the vector part of conj(a) * b, which unlike acos() keeps small angles exact
+double getOrientationError(const geometry_msgs::Quaternion& a, const geometry_msgs::Quaternion& b)
+{
+  const auto w = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+  const auto x = a.w * b.x - b.w * a.x - (a.y * b.z - a.z * b.y);
+  const auto y = a.w * b.y - b.w * a.y - (a.z * b.x - a.x * b.z);
+  const auto z = a.w * b.z - b.w * a.z - (a.x * b.y - a.y * b.x);
+  return 2 * std::atan2(std::sqrt(x * x + y * y + z * z), std::abs(w));
+}
+
+bool isSameBranch(const std::vector<double>& solution, const std::vector<double>& joint_values)
+{
+  for (auto i = 0; i < JOINT_NUM; ++i)
+  {
+    if (!(std::abs(solution[i] - joint_values[i]) <= branch_tolerance))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// FK and IK of the samples of one chunk
+void runChunk(const XarmKinematicsPlugin& plugin, const std::vector<double>& lower_limits,
+              const std::vector<double>& upper_limits, int chunk, int sample_num, Totals& totals)
+{
+  std::mt19937_64 generator(chunk);
+  std::vector<std::vector<double>> samples(sample_num, std::vector<double>(JOINT_NUM));
+  std::vector<geometry_msgs::Pose> poses(sample_num);
+  for (auto i = 0; i < sample_num; ++i)
+  {
+    for (auto j = 0; j < JOINT_NUM; ++j)
+    {
+      samples[i][j] = std::uniform_real_distribution<double>(lower_limits[j], upper_limits[j])(generator);
+    }
+    plugin.computeToolPose(samples[i].data(), poses[i]);
+  }
+
+  // Only the IK from the home pose is timed, it takes the branch closest to the seed as in planning
+  const std::vector<double> home(JOINT_NUM, 0);
+  std::vector<std::vector<double>> solutions(sample_num, std::vector<double>(JOINT_NUM));
+  std::vector<char> solved(sample_num);
+  moveit_msgs::MoveItErrorCodes error_code;
+  const auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < sample_num; ++i)
+  {
+    solved[i] = plugin.searchPositionIK(poses[i], home, 0.005, solutions[i], error_code);
+  }
+  const auto end = std::chrono::steady_clock::now();
+  totals.ik_seconds += std::chrono::duration<double>(end - start).count();
+  totals.sample_num += sample_num;
+
+  geometry_msgs::Pose pose;
+  std::vector<geometry_msgs::Pose> ik_poses(1);
+  std::vector<std::vector<double>> all_solutions;
+  kinematics::KinematicsResult result;
+  const kinematics::KinematicsQueryOptions options;
+  for (auto i = 0; i < sample_num; ++i)
+  {
+    if (solved[i])
+    {
+      ++totals.solved_num;
+      plugin.computeToolPose(solutions[i].data(), pose);
+      const auto position_error = getPositionError(pose, poses[i]);
+      const auto orientation_error = getOrientationError(pose.orientation, poses[i].orientation);
+      totals.max_position_error = std::max(totals.max_position_error, position_error);
+      totals.max_orientation_error = std::max(totals.max_orientation_error, orientation_error);
+      totals.position_error_sum += position_error;
+      totals.orientation_error_sum += orientation_error;
+      ++totals.position_histogram[getErrorBin(position_error)];
+      ++totals.orientation_histogram[getErrorBin(orientation_error)];
+    }
+
+    ik_poses[0] = poses[i];
+    if (plugin.getPositionIK(ik_poses, samples[i], all_solutions, result, options) &&
+        std::any_of(all_solutions.cbegin(), all_solutions.cend(),
+                    [&](const std::vector<double>& solution) { return isSameBranch(solution, samples[i]); }))
+    {
+      ++totals.recovered_num;
+    }
+  }
+}
+
+void logHistogram(const char* name, const ErrorHistogram& histogram, std::uint64_t solved_num)
+{
+  ROS_INFO_NAMED("xarm_kinematics_round_trip", "  %s error:", name);
+  for (auto bin = 0; bin < error_bin_num; ++bin)
+  {
+    if (histogram[bin] == 0)
+    {
+      continue;
+    }
+    const auto percentage = 100.0 * histogram[bin] / std::max<std::uint64_t>(solved_num, 1);
+    if (bin == 0)
+    {
+      ROS_INFO_NAMED("xarm_kinematics_round_trip", "    [0, 1e-12):     %10lu (%6.2f %%)", histogram[bin], percentage);
+    }
+    else if (bin == error_bin_num - 1)
+    {
+      ROS_INFO_NAMED("xarm_kinematics_round_trip", "    [1e-%02d, inf):   %10lu (%6.2f %%)", 13 - bin, histogram[bin],
+                     percentage);
+    }
+    else
+    {
+      ROS_INFO_NAMED("xarm_kinematics_round_trip", "    [1e-%02d, 1e-%02d): %10lu (%6.2f %%)", 13 - bin, 12 - bin,
+                     histogram[bin], percentage);
+    }
+  }
+}
+}  // namespace
+
+// Round trip of random joint values within the limits through the FK and the IK of the plugin, on all cores
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "xarm_kinematics_round_trip");
+  ros::NodeHandle nh;
+  ros::NodeHandle private_nh("~");
+
+  int sample_num;
+  int thread_num;
+  private_nh.param("sample_num", sample_num, 1000000);
+  private_nh.param("thread_num", thread_num, 0);
+  if (thread_num <= 0)
+  {
+    thread_num = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  }
+  if (sample_num <= 0)
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_round_trip", "sample_num must be positive");
+    return 1;
+  }
+
+  robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+  const auto robot_model = robot_model_loader.getModel();
+  const auto joint_model_group = robot_model->getJointModelGroup("xarm_arm");
+  const auto& tip_link = joint_model_group->getLinkModelNames().back();
+
+  xarm_kinematics_plugin::XarmKinematicsPlugin plugin;
+  if (!plugin.initialize(*robot_model, "xarm_arm", "base_link", { tip_link }, 0.005))
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_round_trip", "Failed to initialize the kinematics plugin");
+    return 1;
+  }
+
+  // Limits of the URDF from the robot model
+  std::vector<double> lower_limits;
+  std::vector<double> upper_limits;
+  for (const auto& joint_name : plugin.getJointNames())
+  {
+    const auto& bounds = robot_model->getVariableBounds(joint_name);
+    lower_limits.push_back(bounds.min_position_);
+    upper_limits.push_back(bounds.max_position_);
+  }
+
+  // The workers take the next chunk off the counter until none is left, so a preempted thread does not hold up the
+  // others. Every worker sums up its own totals and hands them over when it is done.
+  const auto chunk_num = (sample_num + chunk_size - 1) / chunk_size;
+  std::atomic<int> next_chunk(0);
+  std::vector<Totals> thread_totals(thread_num, Totals());
+  std::vector<std::thread> threads;
+  const auto start = std::chrono::steady_clock::now();
+  for (auto t = 0; t < thread_num; ++t)
+  {
+    threads.emplace_back([&, t]() {
+      Totals totals = Totals();
+      for (auto chunk = next_chunk++; chunk < chunk_num; chunk = next_chunk++)
+      {
+        runChunk(plugin, lower_limits, upper_limits, chunk, std::min(chunk_size, sample_num - chunk * chunk_size),
+                 totals);
+      }
+      thread_totals[t] = totals;
+    });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  Totals totals = Totals();
+  double solves_per_second = 0;
+  for (const auto& t : thread_totals)
+  {
+    totals.add(t);
+    solves_per_second += t.ik_seconds > 0 ? t.sample_num / t.ik_seconds : 0;
+  }
+  const auto solved_num = std::max<std::uint64_t>(totals.solved_num, 1);
+
+  ROS_INFO_NAMED("xarm_kinematics_round_trip", "Round trip of %lu samples on %d threads in %.2f s:", totals.sample_num,
+                 thread_num, std::chrono::duration<double>(end - start).count());
+  ROS_INFO_NAMED("xarm_kinematics_round_trip", "  Solved from the home pose: %lu (%.4f %%)", totals.solved_num,
+                 100.0 * totals.solved_num / totals.sample_num);
+  ROS_INFO_NAMED("xarm_kinematics_round_trip", "  Sampled branch among all solutions: %lu (%.4f %%)",
+                 totals.recovered_num, 100.0 * totals.recovered_num / totals.sample_num);
+  ROS_INFO_NAMED("xarm_kinematics_round_trip", "  searchPositionIK: %.0f solves/s, %.1f ns per solve and thread",
+                 solves_per_second, 1e9 * totals.ik_seconds / totals.sample_num);
+  ROS_INFO_NAMED("xarm_kinematics_round_trip", "  Position error mean %.3g m max %.3g m",
+                 totals.position_error_sum / solved_num, totals.max_position_error);
+  ROS_INFO_NAMED("xarm_kinematics_round_trip", "  Orientation error mean %.3g rad max %.3g rad",
+                 totals.orientation_error_sum / solved_num, totals.max_orientation_error);
+  logHistogram("Position", totals.position_histogram, totals.solved_num);
+  logHistogram("Orientation", totals.orientation_histogram, totals.solved_num);
+
+  // Every sample is within the limits, so the IK must solve it
+  if (totals.solved_num != totals.sample_num)
+  {
+    ROS_ERROR_NAMED("xarm_kinematics_round_trip", "%lu samples were not solved",
+                    totals.sample_num - totals.solved_num);
+    return 1;
+  }
+
+  return 0;
+}
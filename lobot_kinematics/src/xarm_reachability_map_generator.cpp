@@ -0,0 +1,226 @@
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <ros/ros.h>
+#include <algorithm>
+#include <cmath>
+
+#include "xarm_kinematics_plugin/reachability_map.h"
+#include "xarm_kinematics_plugin/xarm_kinematics_plugin.h"
+
+using xarm_kinematics_plugin::ReachabilityMap;
+
+namespace
+{
+// Reachable cells in the plane of the arm, i.e. the signed distance from the Z axis, the height and the pitch bin. The
+// reach does not depend on arm_joint1 apart from its limits, and arm_joint5 only rolls the tool.
+class PlanarMap
+{
+public:
+  PlanarMap(double max_reach, double resolution, int pitch_bin_num)
+    : cell_num_(static_cast<int>(std::ceil(2 * max_reach / resolution)))
+    , max_reach_(max_reach)
+    , resolution_(resolution)
+    , pitch_bin_num_(pitch_bin_num)
+    , cells_(cell_num_ * cell_num_ * pitch_bin_num, 0)
+  {
+  }
+
+  int getCellNum() const
+  {
+    return cell_num_;
+  }
+
+  int getIndex(double value) const
+  {
+    return static_cast<int>(std::floor((value + max_reach_) / resolution_));
+  }
+
+  double getCenter(int index) const
+  {
+    return (index + 0.5) * resolution_ - max_reach_;
+  }
+
+  bool isReachable(int r, int z, int pitch_bin) const
+  {
+    return r >= 0 && r < cell_num_ && z >= 0 && z < cell_num_ &&
+           cells_[(r * cell_num_ + z) * pitch_bin_num_ + pitch_bin];
+  }
+
+  void setReachable(int r, int z, int pitch_bin)
+  {
+    if (r >= 0 && r < cell_num_ && z >= 0 && z < cell_num_)
+    {
+      cells_[(r * cell_num_ + z) * pitch_bin_num_ + pitch_bin] = 1;
+    }
+  }
+
+  // Marks the neighbors of every reachable cell as well, the sampling of the joints leaves gaps
+  void dilate()
+  {
+    const auto cells = cells_;
+    for (auto r = 0; r < cell_num_; ++r)
+    {
+      for (auto z = 0; z < cell_num_; ++z)
+      {
+        for (auto p = 0; p < pitch_bin_num_; ++p)
+        {
+          if (!cells[(r * cell_num_ + z) * pitch_bin_num_ + p])
+          {
+            continue;
+          }
+          for (auto dr = -1; dr <= 1; ++dr)
+          {
+            for (auto dz = -1; dz <= 1; ++dz)
+            {
+              for (auto dp = std::max(0, p - 1); dp <= std::min(pitch_bin_num_ - 1, p + 1); ++dp)
+              {
+                setReachable(r + dr, z + dz, dp);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const int cell_num_;
+  const double max_reach_;
+  const double resolution_;
+  const int pitch_bin_num_;
+  std::vector<char> cells_;
+};
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "xarm_reachability_map_generator");
+  ros::NodeHandle nh("~");
+
+  std::string output_file;
+  double resolution, joint_step, max_reach;
+  int pitch_bin_num;
+  nh.param<std::string>("output_file", output_file, "xarm_reachability.map");
+  nh.param("resolution", resolution, 0.005);    // Edge of a voxel in meters
+  nh.param("pitch_bin_num", pitch_bin_num, 36);  // Bins of the approach pitch over [-pi/2, pi/2]
+  nh.param("joint_step", joint_step, 0.01);      // Sampling step of arm_joint2 ~ arm_joint4 in radians
+  nh.param("max_reach", max_reach, 0.5);         // Bound of the sampled workspace in meters
+
+  robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+  const auto robot_model = robot_model_loader.getModel();
+  const auto joint_model_group = robot_model->getJointModelGroup("xarm_arm");
+  const auto& variable_names = joint_model_group->getVariableNames();
+  if (variable_names.size() != JOINT_NUM)
+  {
+    ROS_ERROR_NAMED("xarm_reachability_map_generator", "xarm_arm must have %d joints", JOINT_NUM);
+    return 1;
+  }
+
+  std::array<double, JOINT_NUM> lower_limits, upper_limits;
+  for (auto i = 0; i < JOINT_NUM; ++i)
+  {
+    const auto& bounds = robot_model->getVariableBounds(variable_names[i]);
+    lower_limits[i] = bounds.min_position_;
+    upper_limits[i] = bounds.max_position_;
+  }
+
+  // Sample the joints that move the tool in the plane of the arm
+  xarm_kinematics_plugin::XarmKinematicsPlugin plugin;
+  PlanarMap planar_map(max_reach, resolution, pitch_bin_num);
+  ReachabilityMap reachability_map;
+  reachability_map.create({ { 0, 0, 0 } }, { { 1, 1, 1 } }, resolution, pitch_bin_num);  // Only for getPitchBin()
+
+  std::array<double, JOINT_NUM> joint_values{};
+  geometry_msgs::Pose pose;
+  for (joint_values[1] = lower_limits[1]; joint_values[1] <= upper_limits[1]; joint_values[1] += joint_step)
+  {
+    for (joint_values[2] = lower_limits[2]; joint_values[2] <= upper_limits[2]; joint_values[2] += joint_step)
+    {
+      for (joint_values[3] = lower_limits[3]; joint_values[3] <= upper_limits[3]; joint_values[3] += joint_step)
+      {
+        plugin.computeToolPose(joint_values.data(), pose);
+        const auto pitch_bin = reachability_map.getPitchBin(ReachabilityMap::getApproachPitch(pose.orientation));
+        planar_map.setReachable(planar_map.getIndex(pose.position.x), planar_map.getIndex(pose.position.z), pitch_bin);
+      }
+    }
+  }
+  planar_map.dilate();
+
+  // Bounds of the reachable cells, the map is symmetric in X and Y
+  int max_r = 0, min_z = planar_map.getCellNum(), max_z = 0;
+  for (auto r = 0; r < planar_map.getCellNum(); ++r)
+  {
+    for (auto z = 0; z < planar_map.getCellNum(); ++z)
+    {
+      for (auto p = 0; p < pitch_bin_num; ++p)
+      {
+        if (planar_map.isReachable(r, z, p))
+        {
+          max_r = std::max(max_r, static_cast<int>(std::ceil(std::abs(planar_map.getCenter(r)) / resolution)));
+          min_z = std::min(min_z, z);
+          max_z = std::max(max_z, z);
+        }
+      }
+    }
+  }
+  if (min_z > max_z)
+  {
+    ROS_ERROR_NAMED("xarm_reachability_map_generator", "No reachable cell, check the joint limits");
+    return 1;
+  }
+
+  const auto xy_cell_num = 2 * (max_r + 1);
+  const auto z_cell_num = max_z - min_z + 1;
+  const auto xy_origin = -(max_r + 1) * resolution;
+  const auto z_origin = planar_map.getCenter(min_z) - resolution / 2;
+  reachability_map.create({ { xy_origin, xy_origin, z_origin } }, { { xy_cell_num, xy_cell_num, z_cell_num } },
+                          resolution, pitch_bin_num);
+
+  // Rotate the planar map about the Z axis within the limits of arm_joint1, reaching behind with a negative distance
+  auto reachable_num = 0L;
+  const auto is_yaw_reachable = [&](double yaw, double tolerance) {
+    return yaw >= lower_limits[0] - tolerance && yaw <= upper_limits[0] + tolerance;
+  };
+  std::array<std::int32_t, 3> cell;
+  for (cell[0] = 0; cell[0] < xy_cell_num; ++cell[0])
+  {
+    for (cell[1] = 0; cell[1] < xy_cell_num; ++cell[1])
+    {
+      for (cell[2] = 0; cell[2] < z_cell_num; ++cell[2])
+      {
+        for (auto p = 0; p < pitch_bin_num; ++p)
+        {
+          std::array<double, 3> position;
+          double pitch;
+          reachability_map.getCellCenter(cell, p, position, pitch);
+
+          const auto r = std::hypot(position[0], position[1]);
+          const auto yaw = std::atan2(position[1], position[0]);
+          const auto yaw_tolerance = resolution / std::max(r, resolution);  // Half a voxel diagonal on the arc
+          const auto z = planar_map.getIndex(position[2]);
+
+          const auto is_reachable =
+              (is_yaw_reachable(yaw, yaw_tolerance) && planar_map.isReachable(planar_map.getIndex(r), z, p)) ||
+              ((is_yaw_reachable(yaw - M_PI, yaw_tolerance) || is_yaw_reachable(yaw + M_PI, yaw_tolerance)) &&
+               planar_map.isReachable(planar_map.getIndex(-r), z, p));
+          if (is_reachable)
+          {
+            reachability_map.setReachable(cell, p);
+            ++reachable_num;
+          }
+        }
+      }
+    }
+  }
+
+  if (!reachability_map.save(output_file))
+  {
+    ROS_ERROR_NAMED("xarm_reachability_map_generator", "Failed to write %s", output_file.c_str());
+    return 1;
+  }
+
+  ROS_INFO_NAMED("xarm_reachability_map_generator",
+                 "Wrote %s: %d x %d x %d voxels of %g m, %d pitch bins, %ld reachable", output_file.c_str(),
+                 xy_cell_num, xy_cell_num, z_cell_num, resolution, pitch_bin_num, reachable_num);
+
+  return 0;
+}
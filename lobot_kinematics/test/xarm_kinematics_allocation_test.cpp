@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <ros/ros.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include "xarm_kinematics_plugin/benchmark_poses.h"
+#include "xarm_kinematics_plugin/xarm_kinematics_plugin.h"
+
+using xarm_kinematics_plugin::XarmKinematicsPlugin;
+namespace benchmark_poses = xarm_kinematics_plugin::benchmark_poses;
+
+namespace
+{
+constexpr int pose_num = 1000;
+
+// Number of heap allocations through operator new
+std::atomic<long> allocation_num(0);
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+  allocation_num.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size))
+  {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+namespace
+{
+// The IK of a control loop must not touch the heap once the caller's vectors have their size. The first call of each
+// thread may allocate its per-thread state, so every test solves all poses once before counting.
+class XarmKinematicsAllocationTest : public ::testing::Test
+{
+protected:
+  static void SetUpTestCase()
+  {
+    robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+    const auto robot_model = robot_model_loader.getModel();
+    ASSERT_TRUE(robot_model);
+    const auto joint_model_group = robot_model->getJointModelGroup("xarm_arm");
+    ASSERT_TRUE(joint_model_group);
+
+    plugin_.reset(new XarmKinematicsPlugin);
+    ASSERT_TRUE(plugin_->initialize(*robot_model, "xarm_arm", "base_link",
+                                    { joint_model_group->getLinkModelNames().back() }, 0.005));
+  }
+
+  static void TearDownTestCase()
+  {
+    plugin_.reset();
+  }
+
+  void SetUp() override
+  {
+    ASSERT_TRUE(plugin_);
+  }
+
+  // Allocations of fn over the poses of the set, after a first pass over them
+  template <typename Fn>
+  long countAllocations(benchmark_poses::PoseSet pose_set, Fn&& fn)
+  {
+    const auto poses = benchmark_poses::generatePoses(pose_set, pose_num);
+    for (const auto& pose : poses)
+    {
+      fn(pose);
+    }
+
+    const auto start = allocation_num.load();
+    for (const auto& pose : poses)
+    {
+      fn(pose);
+    }
+    return allocation_num.load() - start;
+  }
+
+  static std::unique_ptr<XarmKinematicsPlugin> plugin_;
+
+  const std::vector<double> seed_ = std::vector<double>(JOINT_NUM, 0);
+  std::vector<double> solution_ = std::vector<double>(JOINT_NUM);
+  moveit_msgs::MoveItErrorCodes error_code_;
+};
+
+std::unique_ptr<XarmKinematicsPlugin> XarmKinematicsAllocationTest::plugin_;
+
+TEST_F(XarmKinematicsAllocationTest, SearchPositionIkDoesNotAllocate)
+{
+  for (auto pose_set = 0; pose_set < benchmark_poses::POSE_SET_NUM; ++pose_set)
+  {
+    const auto set = static_cast<benchmark_poses::PoseSet>(pose_set);
+    EXPECT_EQ(0, countAllocations(set, [&](const geometry_msgs::Pose& pose) {
+      plugin_->searchPositionIK(pose, seed_, 0.005, solution_, error_code_);
+    })) << benchmark_poses::getPoseSetName(set);
+  }
+}
+
+TEST_F(XarmKinematicsAllocationTest, GetPositionIkDoesNotAllocate)
+{
+  for (auto pose_set = 0; pose_set < benchmark_poses::POSE_SET_NUM; ++pose_set)
+  {
+    const auto set = static_cast<benchmark_poses::PoseSet>(pose_set);
+    EXPECT_EQ(0, countAllocations(set, [&](const geometry_msgs::Pose& pose) {
+      plugin_->getPositionIK(pose, seed_, solution_, error_code_);
+    })) << benchmark_poses::getPoseSetName(set);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "xarm_kinematics_allocation_test");
+  ros::NodeHandle nh;
+  return RUN_ALL_TESTS();
+}